@@ -92,6 +92,41 @@ uint16_t  I2C_MPR121::touched(void) {
   return t & 0x0FFF;
 }
 
+// Reads touch status, filtered data and baselines for every electrode in a single
+// I2C_RDWR transaction (registers 0x00 to 0x2A; the chip auto-increments the address),
+// instead of one round trip per value.
+bool I2C_MPR121::readAll(MPR121Data *data) {
+    unsigned char inbuf[MPR121_BURST_LEN], outbuf;
+    struct i2c_rdwr_ioctl_data packets;
+    struct i2c_msg messages[2];
+
+    outbuf = MPR121_TOUCHSTATUS_L;
+    messages[0].addr  = _i2c_address;
+    messages[0].flags = 0;
+    messages[0].len   = sizeof(outbuf);
+    messages[0].buf   = &outbuf;
+
+    messages[1].addr  = _i2c_address;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len   = sizeof(inbuf);
+    messages[1].buf   = inbuf;
+
+    packets.msgs      = messages;
+    packets.nmsgs     = 2;
+    if(ioctl(i2C_file, I2C_RDWR, &packets) < 0) {
+        rt_printf("Unable to send data");
+        return false;
+    }
+
+    data->touched = ((uint16_t)inbuf[MPR121_TOUCHSTATUS_L] | ((uint16_t)inbuf[MPR121_TOUCHSTATUS_H] << 8)) & 0x0FFF;
+    for (uint8_t t = 0; t < MPR121_NUM_ELECTRODES; t++) {
+      uint8_t reg = MPR121_FILTDATA_0L + t*2;
+      data->filtered[t] = (uint16_t)inbuf[reg] | ((uint16_t)inbuf[reg + 1] << 8);
+      data->baseline[t] = (uint16_t)inbuf[MPR121_BASELINE_0 + t] << 2;
+    }
+    return true;
+}
+
 /*********************************************************************/
 
 
@@ -55,6 +55,16 @@ typedef bool boolean;
 
 #define MPR121_SOFTRESET 0x80
 
+#define MPR121_NUM_ELECTRODES 12
+#define MPR121_BURST_LEN (MPR121_MHDR - MPR121_TOUCHSTATUS_L) // Registers 0x00 to 0x2A
+
+// Everything readAll() fetches in one go.
+struct MPR121Data {
+	uint16_t touched;							// One bit per electrode
+	uint16_t filtered[MPR121_NUM_ELECTRODES];
+	uint16_t baseline[MPR121_NUM_ELECTRODES];	// Already shifted up to match filtered
+};
+
 class I2C_MPR121 : public I2c
 {
 public:
@@ -70,6 +80,7 @@ public:
 	uint16_t readRegister16(uint8_t reg);
 	void writeRegister(uint8_t reg, uint8_t value);
 	uint16_t touched(void);
+	bool readAll(MPR121Data *data);
  
  	void setThresholds(uint8_t touch, uint8_t release);
 	
@@ -8,10 +8,20 @@
 #ifndef SAMPLEDATA_H_
 #define SAMPLEDATA_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#define SAMPLE_INT16_SCALE (1.0f / 32768.0f) // From samples16 to the same range as samples
+
 // User defined structure to pass between main and rendere complex data retrieved from file
 struct SampleData {
 	float *samples;	// Samples in file
+	int16_t *samples16;	// Or, stored as 16 bit to halve the memory (samples is then NULL)
 	int sampleLen;	// Total nume of samples
+	int residentLen;	// How many of them are in samples (fewer when streaming, see streaming.hpp)
+	int sampleRate;		// Of the file they came from (voices play them back at whatever rate, see mixer.hpp)
+	void *mapped;		// If samples point into an mmapped cache file (see sampleCache.hpp), the mapping;
+	size_t mappedLen;	// otherwise NULL and samples came from new[]
 };
 
 
@@ -4,10 +4,66 @@
 #include <sndfile.h>				// to load audio files
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <SampleData.h>
 
 using namespace std;
 
+#define SAMPLE_LOAD_CHUNK_FRAMES 4096 // Frames read from the file at a time
+
+// What to multiply an open file's samples by: float and double files are scaled so their peak
+// is 32700, others are left as they are. Finding the peak reads the whole file.
+static double sampleFileScale(SNDFILE *sndfile, SF_INFO &sfinfo)
+{
+	int subformat = sfinfo.format & SF_FORMAT_SUBMASK;
+	if (subformat != SF_FORMAT_FLOAT && subformat != SF_FORMAT_DOUBLE)
+		return 1.0;
+	double scale;
+	sf_command(sndfile, SFC_CALC_SIGNAL_MAX, &scale, sizeof(scale));
+	if (scale < 1e-10)
+		return 1.0;
+	return 32700.0 / scale;
+}
+
+// Read frames startFrame to endFrame of one channel of an open file into buf, multiplied by
+// scale (from sampleFileScale()). The file is read a chunk at a time, so we never hold more
+// than a chunk of the other channels. Messages go to log.
+static int readChannel(SNDFILE *sndfile, SF_INFO &sfinfo, float *buf, int channel, int startFrame, int endFrame,
+	double scale, ostream &log = cout)
+{
+	int numChannelsInFile = sfinfo.channels;
+	int frameLen = endFrame - startFrame;
+
+	sf_seek(sndfile, startFrame, SEEK_SET);
+
+	vector<float> chunk(SAMPLE_LOAD_CHUNK_FRAMES * numChannelsInFile);
+	int frame = 0;
+	while(frame < frameLen) {
+		int n = frameLen - frame < SAMPLE_LOAD_CHUNK_FRAMES ? frameLen - frame : SAMPLE_LOAD_CHUNK_FRAMES;
+		int readcount = sf_readf_float(sndfile, chunk.data(), n);
+		if(readcount <= 0)
+			break;
+		for(int k = 0; k < readcount; k++)
+			buf[frame + k] = chunk[k * numChannelsInFile + channel];
+		frame += readcount;
+	}
+	// Pad with zeros in case we couldn't read whole file
+	for(; frame < frameLen; frame++)
+		buf[frame] = 0;
+
+	if (scale != 1.0) {
+		log << "File samples scale = " << scale << endl;
+		for (int m = 0; m < frameLen; m++)
+			buf[m] *= scale;
+	}
+	return 0;
+}
+
 // Load samples from file
 int getSamples(string file, float *buf, int channel, int startFrame, int endFrame)
 {
@@ -23,54 +79,107 @@ int getSamples(string file, float *buf, int channel, int startFrame, int endFram
 	if(numChannelsInFile < channel+1)
 	{
 		cout << "Error: " << file << " doesn't contain requested channel" << endl;
+		sf_close(sndfile);
 		return 1;
 	}
-    
+
     int frameLen = endFrame-startFrame;
-    
+
     if(frameLen <= 0 || startFrame < 0 || endFrame <= 0 || endFrame > sfinfo.frames)
 	{
 	    //printf("framelen %d startframe %d endframe %d, sfinfo.frames %d\n",frameLen,startFrame,endFrame,sfinfo.frames);
 		cout << "Error: " << file << " invalid frame range requested" << endl;
+		sf_close(sndfile);
 		return 1;
 	}
-    
-    sf_seek(sndfile,startFrame,SEEK_SET);
-    
-    float* tempBuf = new float[frameLen*numChannelsInFile];
-    
-	int subformat = sfinfo.format & SF_FORMAT_SUBMASK;
-	int readcount = sf_read_float(sndfile, tempBuf, frameLen*numChannelsInFile); //FIXME
 
-	// Pad with zeros in case we couldn't read whole file
-	for(int k = readcount; k <frameLen*numChannelsInFile; k++)
-		tempBuf[k] = 0;
-
-	if (subformat == SF_FORMAT_FLOAT || subformat == SF_FORMAT_DOUBLE) {
-		double	scale ;
-		int 	m ;
-
-		sf_command (sndfile, SFC_CALC_SIGNAL_MAX, &scale, sizeof (scale)) ;
-		if (scale < 1e-10)
-			scale = 1.0 ;
-		else
-			scale = 32700.0 / scale ;
-		cout << "File samples scale = " << scale << endl;
-
-		for (m = 0; m < frameLen; m++)
-			tempBuf[m] *= scale;
+	readChannel(sndfile, sfinfo, buf, channel, startFrame, endFrame, sampleFileScale(sndfile, sfinfo));
+
+	sf_close(sndfile);
+
+	return 0;
+}
+
+// Load one channel of a whole file into sample (allocating sample->samples with new[]), opening
+// the file just once. Messages go to log, so loader threads can keep theirs apart.
+int loadSample(string file, int channel, SampleData *sample, ostream &log = cout)
+{
+	SNDFILE *sndfile ;
+	SF_INFO sfinfo ;
+	sfinfo.format = 0;
+	if (!(sndfile = sf_open (file.c_str(), SFM_READ, &sfinfo))) {
+		log << "Couldn't open file " << file << ": " << sf_strerror(sndfile) << endl;
+		return 1;
+	}
+	if(sfinfo.channels < channel+1 || sfinfo.frames <= 0)
+	{
+		log << "Error: " << file << " doesn't contain requested channel" << endl;
+		sf_close(sndfile);
+		return 1;
 	}
-	
-	for(int n=0;n<frameLen;n++)
-	    buf[n] = tempBuf[n*numChannelsInFile+channel];
+
+	sample->samples = new float[sfinfo.frames];
+	sample->samples16 = NULL;
+	sample->sampleLen = sfinfo.frames;
+	sample->residentLen = sfinfo.frames;
+	sample->sampleRate = sfinfo.samplerate;
+	sample->mapped = NULL;
+	sample->mappedLen = 0;
+	readChannel(sndfile, sfinfo, sample->samples, channel, 0, sfinfo.frames, sampleFileScale(sndfile, sfinfo), log);
 
 	sf_close(sndfile);
 
 	return 0;
 }
 
+// Run load(i, log) for every one of files, spread over worker threads (the time goes on disk
+// reads as much as decoding, so it's worth it even on one core). Each load writes its messages
+// to its own log, and once they're all done they're printed in order, with how long each took.
+// Returns false if any load(i, log) did.
+template <typename LoadFunction>
+bool loadSamplesInParallel(const vector<string> &files, LoadFunction load, unsigned int numThreads = 0)
+{
+	if(numThreads == 0)
+		numThreads = thread::hardware_concurrency() > 2 ? thread::hardware_concurrency() : 2;
+	if(numThreads > files.size())
+		numThreads = files.size();
+
+	vector<double> times(files.size());
+	vector<char> ok(files.size());
+	vector<string> logs(files.size());
+	atomic<unsigned int> next(0);
+	auto worker = [&]() {
+		unsigned int i;
+		while((i = next++) < files.size()) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			ostringstream log;
+			ok[i] = load(i, log);
+			logs[i] = log.str();
+			times[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+	};
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for(unsigned int t = 1; t < numThreads; t++)
+		threads.push_back(thread(worker));
+	worker();
+	for(unsigned int t = 0; t < threads.size(); t++)
+		threads[t].join();
+	double total = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	bool allOk = true;
+	for(unsigned int i = 0; i < files.size(); i++) {
+		cout << logs[i];
+		cout << "Loaded " << files[i] << " in " << times[i] << " ms" << (ok[i] ? "" : " (failed)") << endl;
+		allOk = allOk && ok[i];
+	}
+	cout << "Loaded " << files.size() << " files in " << total << " ms on " << (numThreads ? numThreads : 1) << " threads" << endl;
+	return allOk;
+}
+
 int getNumChannels(string file) {
-    
+
 	SNDFILE *sndfile ;
 	SF_INFO sfinfo ;
 	sfinfo.format = 0;
@@ -78,12 +187,27 @@ int getNumChannels(string file) {
 		cout << "Couldn't open file " << file << ": " << sf_strerror(sndfile) << endl;
 		return -1;
 	}
+	sf_close(sndfile);
 
 	return sfinfo.channels;
 }
 
+int getSampleRate(string file) {
+
+	SNDFILE *sndfile ;
+	SF_INFO sfinfo ;
+	sfinfo.format = 0;
+	if (!(sndfile = sf_open (file.c_str(), SFM_READ, &sfinfo))) {
+		cout << "Couldn't open file " << file << ": " << sf_strerror(sndfile) << endl;
+		return -1;
+	}
+	sf_close(sndfile);
+
+	return sfinfo.samplerate;
+}
+
 int getNumFrames(string file) {
-    
+
 	SNDFILE *sndfile ;
 	SF_INFO sfinfo ;
 	sfinfo.format = 0;
@@ -91,7 +215,7 @@ int getNumFrames(string file) {
 		cout << "Couldn't open file " << file << ": " << sf_strerror(sndfile) << endl;
 		return -1;
 	}
+	sf_close(sndfile);
 
 	return sfinfo.frames;
 }
-
@@ -1,6 +1,10 @@
 /***** accelerometer.hpp *****/
 
+#include "filters.hpp"
+
 // Function declarations:
+void setupAccelerometer(double analogSampleRate);
+void calculateCoeffs(double sampleRate);	// coeffs.hpp
 void readAccelerometer(BelaContext *context, int currentFrame);
 void setLights(BelaContext *context, int currentFrame, int lightState);
 void lightState(BelaContext *context, int frame, float peakValue);
@@ -9,21 +13,26 @@ extern int ledPins[];
 
 extern int gIsAudioMuted;
 
-// Values for the filters. These are the past inputs:
-double x_xValues[2] = { 0 };
-double y_xValues[2] = { 0 };
-double z_xValues[2] = { 0 };
-// ... and these are the past outputs:
-double x_yValues[2] = { 0 };
-double y_yValues[2] = { 0 };
-double z_yValues[2] = { 0 };
-
-double scopeX, scopeY, scopeZ;
-
-// Save the past values for the DC blocking filter:
-double x_DC_in, x_DC_out, y_DC_in, y_DC_out, z_DC_in, z_DC_out = 0;
-
-int gWritePointer = 0;
+// The accelerometer only drives the lights and the mute, which change over seconds, so the
+// filters and everything after them run at a control rate. The analog frames are averaged in
+// groups of accelDecimation (a boxcar: with the lowpass after it, plenty to stop aliasing) and
+// the rest runs once per group, with the lowpass designed for that rate (see coeffs.hpp).
+// The constants that act once per step are rescaled in setupAccelerometer() so the lights
+// respond as they did at the full rate: the DC blocker's R becomes R^D, and a step takes off
+// D times gRolloff and D times thresh, as its motion is D frames' worth.
+// accelDecimation = 1 runs at the full analog rate, exactly as before.
+int accelDecimation = 32;		// Analog frames per control step (22050 / 32 = 689Hz)
+#define ACCEL_DC_R 0.9998		// Per analog frame
+
+double gAccelSum[3] = { 0 };	// The group so far
+int gAccelCount = 0;
+double gStepRolloff;			// gRolloff and thresh per control step
+double gStepThresh;
+
+// The filters for the three axes (analog inputs 4-6, see filters.hpp). Doubles, as the
+// motion we look for is tiny next to the signal:
+Biquad<double, 3> gAccelLowpass;
+DCBlocker<double, 3> gAccelDC;
 
 double gRolloff = 0.000029;
 // double gRolloff = 0.1;
@@ -50,46 +59,55 @@ extern double gW0_high;
 
 int gInTimeout = 0;
 
+// Also designs the lowpass for the control rate, once accelDecimation is known to be sane.
+void setupAccelerometer(double analogSampleRate) {
+	if (accelDecimation < 1)
+		accelDecimation = 1;
+	calculateCoeffs(analogSampleRate / accelDecimation);
+	gAccelLowpass.setCoefficients(gLowB0, gLowB1, gLowB2, gLowA1, gLowA2);
+	gAccelLowpass.reset();
+	gAccelDC.setup(pow(ACCEL_DC_R, accelDecimation));
+	gStepRolloff = gRolloff * accelDecimation;
+	gStepThresh = thresh * accelDecimation;
+	gAccelCount = 0;
+	gAccelSum[0] = gAccelSum[1] = gAccelSum[2] = 0;
+}
+
+// Call once per analog frame. Only every accelDecimation'th call does more than add up.
 void readAccelerometer(BelaContext *context, int frame) {
 	
+	const float *in = context->analogIn + (frame/2) * context->analogInChannels + 4;
+	for (int i = 0; i < 3; i++) {
+		gAccelSum[i] += in[i];
+	}
+	if (++gAccelCount < accelDecimation) {
+		return;
+	}
+	double averaged[3];
+	for (int i = 0; i < 3; i++) {
+		averaged[i] = gAccelSum[i] * (1.0 / accelDecimation);
+		gAccelSum[i] = 0;
+	}
+	gAccelCount = 0;
 	
-    double xIn = analogRead(context, frame/2, 4);
-    double yIn = analogRead(context, frame/2, 5);
-    double zIn = analogRead(context, frame/2, 6);
-    
     // LPF!
-    // y[n] = (B0 * x[n] + B1 * x[n-1] + B2 x[n-2] - A1 * x[n-1] - A2 * x[n-2])
-    double x_LP = (gLowB0 * xIn) + (gLowB1 * x_xValues[(gWritePointer + 2 - 1) % 2]) + (gLowB2 * x_xValues[gWritePointer]) - (gLowA1 * x_yValues[(gWritePointer + 2 - 1) % 2]) - gLowA2 * x_yValues[gWritePointer];
-    double y_LP = (gLowB0 * yIn) + (gLowB1 * y_xValues[(gWritePointer + 2 - 1) % 2]) + (gLowB2 * y_xValues[gWritePointer]) - (gLowA1 * y_yValues[(gWritePointer + 2 - 1) % 2]) - gLowA2 * y_yValues[gWritePointer];
-    double z_LP = (gLowB0 * zIn) + (gLowB1 * z_xValues[(gWritePointer + 2 - 1) % 2]) + (gLowB2 * z_xValues[gWritePointer]) - (gLowA1 * z_yValues[(gWritePointer + 2 - 1) % 2]) - gLowA2 * z_yValues[gWritePointer];
+    double lowpassed[3];
+    gAccelLowpass.process(averaged, 3, lowpassed, 3, 1);
     
-
-    // Save the raw X values for next time:
-    x_xValues[gWritePointer] = xIn;
-    y_xValues[gWritePointer] = yIn;
-    z_xValues[gWritePointer] = zIn;
-    
-
+    // Perform DC filtering! (Keeping the last DC output to measure the motion from.)
+    double lastDC[3] = { gAccelDC.y1[0], gAccelDC.y1[1], gAccelDC.y1[2] };
+    double dc[3];
+    gAccelDC.process(lowpassed, 3, dc, 3, 1);
     
-    // Also, save the filtered Y values for next time:
-    x_yValues[gWritePointer] = x_LP;
-    y_yValues[gWritePointer] = y_LP;
-    z_yValues[gWritePointer] = z_LP;
-
-    // Perform DC filtering!
-    double x_DC = (x_LP - x_DC_in + 0.9998 * x_DC_out);
-    double y_DC = (y_LP - y_DC_in + 0.9998 * y_DC_out);
-    double z_DC = (z_LP - z_DC_in + 0.9998 * z_DC_out);
+    double x_motion = (dc[0] - lastDC[0]) * (dc[0] - lastDC[0]);
     
-    double x_motion = (x_DC - x_DC_out) * (x_DC - x_DC_out);
+    double y_motion = (dc[1] - lastDC[1]) * (dc[1] - lastDC[1]);
     
-    double y_motion = (y_DC - y_DC_out) * (y_DC - y_DC_out);
-    
-    double z_motion = (z_DC - z_DC_out) * (z_DC - z_DC_out);
+    double z_motion = (dc[2] - lastDC[2]) * (dc[2] - lastDC[2]);
     
 	gTotalMotion = sqrt( x_motion + y_motion + z_motion );
 	// gTotalMotion = x_motion + y_motion + z_motion; // squared euclidean distance
-	gTotalMotion -= thresh;
+	gTotalMotion -= gStepThresh;
 	if (gTotalMotion < 0) {
 		gTotalMotion = 0;
 	}
@@ -100,7 +118,7 @@ void readAccelerometer(BelaContext *context, int frame) {
 	    if (gPeak > 2) {
 	    	gPeak = 2;
 	    }
-	    gPeak -= gRolloff;
+	    gPeak -= gStepRolloff;
 	    if (gPeak < 0) {
 	    	gPeak = 0;
 	    }
@@ -109,22 +127,6 @@ void readAccelerometer(BelaContext *context, int frame) {
     
 	
 	//setLights(context, frame, gLightState);
-    
-    // Save the X and Y values for the DC filter (we only need the last one):
-    x_DC_in = x_LP;
-    x_DC_out = x_DC;
-    
-    y_DC_in = y_LP;
-    y_DC_out = y_DC;
-    
-    z_DC_in = z_LP;
-    z_DC_out = z_DC;
-    
-    // Advance the write pointer: 
-    gWritePointer++;
-    if (gWritePointer > 1) {
-    	gWritePointer = 0;
-    }
 
 }
 
@@ -158,7 +160,7 @@ void lightState(BelaContext *context, int frame, float peakValue) {
 		
 	// When count down is done, move to 0 and charge up again
 	if (gLightState != gPrevLightState) {
-		rt_printf("light state moved to %d\n", gLightState);
+		EVENT_LIGHT_STATE(gLightState);
 		// Blink the lights accordingly:
 		setLights(context, frame, gLightState);
 	}
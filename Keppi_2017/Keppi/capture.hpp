@@ -0,0 +1,292 @@
+/***** capture.hpp *****/
+/*
+	Records everything Keppi senses to a file, so it can be played back through the offline
+	renderer (host/render_offline.cpp --capture) and come out the same.
+
+	A capture is a 64-byte header and then records, each a 16-byte record header and its data:
+	- analog: one per block, stamped with the block's first frame. The seven analog inputs we
+	  use (the piezos on 0-3, the accelerometer on 4-6), every analog frame, as floats.
+	- MPR121: one per read of the chip, stamped with the frame the read was scheduled at. The
+	  touch bits, filtered data and baselines (as readAll() gave them), and the first frame of
+	  the block that collected them, i.e. when the audio thread could first have handled them.
+	- gap: blocks (and reads) that were dropped because the writer fell behind.
+	Frames are audio frames since the start. Everything is little-endian, as on the board.
+
+	Define ENABLE_CAPTURE in defs.hpp to switch it on; otherwise the CAPTURE_ macros are empty.
+	The audio thread appends records to one of two buffers allocated in setup(). When it is
+	half full and the other one has been written, they swap and an auxiliary task writes the
+	full one out, so the audio thread never waits for the disk. If both are full, blocks are
+	dropped (and a gap record says where). The MPR121 task hands its reads to the audio
+	thread through a queue, so only the audio thread writes the buffers.
+
+	Playback is exact as long as it reads the chip at the same frames as the board did: run
+	it with the same settings (the header keeps the block size, read interval and IRQ mode),
+	with no more than one read in a block (the host can't do two; it refuses such captures),
+	and set touchEventDelay longer than the MPR121 task takes, so touches are handled a fixed
+	time after their read rather than whenever the task finished (the host's finishes at once).
+	The offline renderer warns about reads whose touches were handled late.
+
+	Keep this file's header and record layout in step with CAPTURE_VERSION: the host reads it.
+*/
+
+#ifndef CAPTURE_HPP_
+#define CAPTURE_HPP_
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC 0x5041434B		// "KCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_ANALOG_CHANNELS 7
+#define CAPTURE_ELECTRODES 12
+
+struct CaptureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;			// sizeof(CaptureHeader)
+	float audioSampleRate;
+	float analogSampleRate;
+	uint32_t audioFrames;			// Per block
+	uint32_t analogFrames;			// Per block
+	uint32_t analogChannels;		// CAPTURE_ANALOG_CHANNELS
+	uint32_t electrodes;			// CAPTURE_ELECTRODES
+	uint32_t readIntervalSamples;	// Settings that decide when the MPR121 is read
+	int32_t useInterrupt;
+	int32_t touchEventDelay;
+	uint32_t reserved[4];
+};
+
+enum {
+	kCaptureAnalog = 1,		// analogFrames * analogChannels floats
+	kCaptureMPR121,			// CaptureMPR121
+	kCaptureGap,			// CaptureGap; frame is the first block dropped
+};
+
+struct CaptureRecordHeader {
+	uint32_t type;
+	uint32_t size;			// Bytes of data after this header
+	uint64_t frame;
+};
+
+struct CaptureMPR121 {
+	uint64_t collectedFrame;
+	uint16_t touched;
+	uint16_t filtered[CAPTURE_ELECTRODES];
+	uint16_t baseline[CAPTURE_ELECTRODES];
+	uint16_t unused[3];
+};
+
+struct CaptureGap {
+	uint32_t blocks;
+	uint32_t reads;
+};
+
+static_assert(sizeof(CaptureHeader) == 64, "CaptureHeader should be 64 bytes");
+static_assert(sizeof(CaptureRecordHeader) == 16, "CaptureRecordHeader should be 16 bytes");
+static_assert(sizeof(CaptureMPR121) == 64, "CaptureMPR121 should be 64 bytes");
+
+#if defined(ENABLE_CAPTURE) && !defined(CAPTURE_FORMAT_ONLY)
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "spscQueue.hpp"
+
+#define CAPTURE_BUFFER_BYTES (1 << 20)	// Each of two; about 1.6s of blocks
+#define CAPTURE_READ_QUEUE_SIZE 16
+
+const char *captureFile = "capture.kcap";	// In the project folder
+int captureWaitMs = 2000;					// How long cleanup() waits for the writer task
+
+extern int readIntervalSamples;
+extern int useInterrupt;
+extern int touchEventDelay;
+
+struct CaptureRead {
+	uint64_t frame;
+	MPR121Data data;
+};
+
+uint8_t *gCaptureBuffers[2] = { NULL, NULL };
+size_t gCaptureUsed[2] = { 0, 0 };
+int gCaptureActive = 0;
+std::atomic<bool> gCaptureWriteBusy(false);	// From handing a buffer over until it's written
+std::atomic<bool> gCaptureWriteTaken(false);	// Whoever sets this writes the handed-over buffer
+SpscQueue<CaptureRead, CAPTURE_READ_QUEUE_SIZE> gCaptureReads;
+std::atomic<unsigned int> gCaptureReadsDropped(0);	// By the MPR121 task, when the queue is full
+CaptureGap gCaptureGap = { 0, 0 };				// Dropped since the last record that fitted
+uint64_t gCaptureGapFrame = 0;
+uint32_t gCaptureTotalDropped = 0;
+FILE *gCaptureFile = NULL;
+AuxiliaryTask gCaptureTask;
+
+void writeCaptureBuffer();
+
+void captureSetup(BelaContext *context) {
+	if (context->analogInChannels < CAPTURE_ANALOG_CHANNELS) {
+		rt_printf("Capture needs %d analog inputs; not capturing\n", CAPTURE_ANALOG_CHANNELS);
+		return;
+	}
+	gCaptureFile = fopen(captureFile, "wb");
+	if (!gCaptureFile) {
+		rt_printf("Couldn't open %s for the capture\n", captureFile);
+		return;
+	}
+	CaptureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	header.headerSize = sizeof(header);
+	header.audioSampleRate = context->audioSampleRate;
+	header.analogSampleRate = context->analogSampleRate;
+	header.audioFrames = context->audioFrames;
+	header.analogFrames = context->analogFrames;
+	header.analogChannels = CAPTURE_ANALOG_CHANNELS;
+	header.electrodes = CAPTURE_ELECTRODES;
+	header.readIntervalSamples = readIntervalSamples;
+	header.useInterrupt = useInterrupt;
+	header.touchEventDelay = touchEventDelay;
+	fwrite(&header, sizeof(header), 1, gCaptureFile);
+
+	for (int b = 0; b < 2; b++) {
+		gCaptureBuffers[b] = new uint8_t[CAPTURE_BUFFER_BYTES];
+		gCaptureUsed[b] = 0;
+	}
+	gCaptureTask = Bela_createAuxiliaryTask(writeCaptureBuffer, 15, "bela-capture");
+	rt_printf("Capturing the sensors to %s\n", captureFile);
+}
+
+// Audio thread: room for a record with size bytes of data in the active buffer, with its
+// header filled in, or NULL if it doesn't fit.
+static inline uint8_t *captureRecord(uint32_t type, uint32_t size, uint64_t frame) {
+	if (gCaptureUsed[gCaptureActive] + sizeof(CaptureRecordHeader) + size > CAPTURE_BUFFER_BYTES)
+		return NULL;
+	uint8_t *p = gCaptureBuffers[gCaptureActive] + gCaptureUsed[gCaptureActive];
+	CaptureRecordHeader header = { type, size, frame };
+	memcpy(p, &header, sizeof(header));
+	gCaptureUsed[gCaptureActive] += sizeof(header) + size;
+	return p + sizeof(header);
+}
+
+// MPR121 task: a read has come back.
+static inline void captureMPR121(uint64_t frame, const MPR121Data& data) {
+	if (!gCaptureFile)
+		return;
+	CaptureRead read = { frame, data };
+	if (!gCaptureReads.push(read))
+		gCaptureReadsDropped.store(gCaptureReadsDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Audio thread, at the start of every block: record the block's analog input and the reads
+// that have come back since the last one.
+static inline void captureBlock(BelaContext *context) {
+	if (!gCaptureFile)
+		return;
+	uint64_t frame = context->audioFramesElapsed;
+	uint32_t analogSize = context->analogFrames * CAPTURE_ANALOG_CHANNELS * sizeof(float);
+	size_t needed = 2 * sizeof(CaptureRecordHeader) + sizeof(CaptureGap) + analogSize
+		+ CAPTURE_READ_QUEUE_SIZE * (sizeof(CaptureRecordHeader) + sizeof(CaptureMPR121));
+
+	if (gCaptureUsed[gCaptureActive] + needed > CAPTURE_BUFFER_BYTES) {
+		// No room for this block: drop it, and its reads.
+		if (gCaptureGap.blocks == 0)
+			gCaptureGapFrame = frame;
+		gCaptureGap.blocks++;
+		CaptureRead read;
+		while (gCaptureReads.pop(read))
+			gCaptureGap.reads++;
+	} else {
+		if (gCaptureGap.blocks > 0) {
+			memcpy(captureRecord(kCaptureGap, sizeof(CaptureGap), gCaptureGapFrame), &gCaptureGap, sizeof(CaptureGap));
+			gCaptureTotalDropped += gCaptureGap.blocks;
+			gCaptureGap.blocks = gCaptureGap.reads = 0;
+		}
+		float *analog = (float *)captureRecord(kCaptureAnalog, analogSize, frame);
+		for (unsigned int n = 0; n < context->analogFrames; n++)
+			memcpy(analog + n * CAPTURE_ANALOG_CHANNELS, context->analogIn + n * context->analogInChannels,
+				CAPTURE_ANALOG_CHANNELS * sizeof(float));
+		CaptureRead read;
+		while (gCaptureReads.pop(read)) {
+			CaptureMPR121 record;
+			memset(&record, 0, sizeof(record));
+			record.collectedFrame = frame;
+			record.touched = read.data.touched;
+			memcpy(record.filtered, read.data.filtered, sizeof(record.filtered));
+			memcpy(record.baseline, read.data.baseline, sizeof(record.baseline));
+			memcpy(captureRecord(kCaptureMPR121, sizeof(record), read.frame), &record, sizeof(record));
+		}
+	}
+
+	// Hand over the active buffer once it's half full, if the other one has been written.
+	if (gCaptureUsed[gCaptureActive] >= CAPTURE_BUFFER_BYTES / 2 && !gCaptureWriteBusy.load(std::memory_order_acquire)) {
+		gCaptureActive = !gCaptureActive;
+		gCaptureWriteTaken.store(false, std::memory_order_relaxed);
+		gCaptureWriteBusy.store(true, std::memory_order_release);
+		Bela_scheduleAuxiliaryTask(gCaptureTask);
+	}
+}
+
+// Writes out the buffer the audio thread isn't using, unless someone else already has it.
+static bool writeFullCaptureBuffer() {
+	if (gCaptureWriteTaken.exchange(true, std::memory_order_acq_rel))
+		return false;
+	int full = !gCaptureActive;
+	fwrite(gCaptureBuffers[full], 1, gCaptureUsed[full], gCaptureFile);
+	gCaptureUsed[full] = 0;
+	gCaptureWriteBusy.store(false, std::memory_order_release);
+	return true;
+}
+
+// Auxiliary task.
+void writeCaptureBuffer() {
+	writeFullCaptureBuffer();
+}
+
+// Wait up to captureWaitMs for the writer task. Returns true once nothing is being written.
+static bool waitForCaptureWriter() {
+	for (int waited = 0; gCaptureWriteBusy.load(std::memory_order_acquire); waited++) {
+		if (waited >= captureWaitMs)
+			return false;
+		usleep(1000);
+	}
+	return true;
+}
+
+// After the audio thread has stopped: write what's left and close the file. If the writer task
+// never got to run (the auxiliary tasks may have stopped first), write its buffer here. If it is
+// still writing after the wait, leave the file and buffers to it.
+void captureCleanup() {
+	if (!gCaptureFile)
+		return;
+	if (!waitForCaptureWriter() && !writeFullCaptureBuffer() && !waitForCaptureWriter()) {
+		rt_printf("The capture writer didn't finish; %s is incomplete\n", captureFile);
+		return;
+	}
+	fwrite(gCaptureBuffers[gCaptureActive], 1, gCaptureUsed[gCaptureActive], gCaptureFile);
+	fclose(gCaptureFile);
+	gCaptureFile = NULL;
+	gCaptureTotalDropped += gCaptureGap.blocks;
+	unsigned int readsDropped = gCaptureReadsDropped.load(std::memory_order_relaxed);
+	if (gCaptureTotalDropped || readsDropped)
+		rt_printf("Capture dropped %u blocks and %u MPR121 reads\n", gCaptureTotalDropped, readsDropped);
+	for (int b = 0; b < 2; b++) {
+		delete[] gCaptureBuffers[b];
+		gCaptureBuffers[b] = NULL;
+	}
+}
+
+#define CAPTURE_SETUP(context) captureSetup(context)
+#define CAPTURE_MPR121(frame, data) captureMPR121(frame, data)
+#define CAPTURE_BLOCK(context) captureBlock(context)
+#define CAPTURE_CLEANUP() captureCleanup()
+
+#elif !defined(CAPTURE_FORMAT_ONLY)
+
+#define CAPTURE_SETUP(context)
+#define CAPTURE_MPR121(frame, data)
+#define CAPTURE_BLOCK(context)
+#define CAPTURE_CLEANUP()
+
+#endif /* ENABLE_CAPTURE */
+
+#endif /* CAPTURE_HPP_ */
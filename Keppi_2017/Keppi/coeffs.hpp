@@ -11,10 +11,10 @@ double gLowA1, gLowA2, gHighA1, gHighA2, gLowB0, gLowB1, gLowB2, gHighB0, gHighB
 double gW0_low = 30.0; // 200.0;
 double gW0_high = 0.3; // 20.0;
 
-// Calculates coeffs for filters. Doesn't return anything, just sets variables.
-void calculateCoeffs() {
+// Calculates coeffs for filters running at sampleRate. Doesn't return anything, just sets variables.
+void calculateCoeffs(double sampleRate) {
     // Calculate:
-    double t = 1 / SAMPLE_RATE;
+    double t = 1 / sampleRate;
 	double t2 = t * t;
 	double q = sqrt2 / 2;
 	double w02_high = gW0_high * gW0_high;
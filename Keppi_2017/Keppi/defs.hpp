@@ -5,5 +5,18 @@
 #define NUM_PIEZO_VALUES_BACK 100
 #define NUM_PIEZO_VALUES_FRONT 220
 #define NUM_HOLD_SAMPLES 4000
-#define NUM_VOICES 20
+#define MAX_VOICES 128		// Voices allocated; numVoices (render.cpp, --voices) says how many play
+#define DEFAULT_VOICES 20
 #define NUM_SENSORS 4
+
+// Uncomment to time each stage of render() and print a report every second (see profiler.hpp):
+// #define ENABLE_PROFILER
+
+// Uncomment to trace every hit from MPR121 poll to first sound and print per-pad latencies (see latency.hpp):
+// #define ENABLE_LATENCY_TRACE
+
+// Uncomment to record the analog inputs and MPR121 reads for the offline renderer (see capture.hpp):
+// #define ENABLE_CAPTURE
+
+// Uncomment to take the event log (hits, voices, light states; see eventLog.hpp) out of render():
+// #define DISABLE_EVENT_LOG
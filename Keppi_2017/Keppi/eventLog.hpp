@@ -0,0 +1,178 @@
+/***** eventLog.hpp *****/
+/*
+	What the audio thread did, for the console: every hit with its piezo peak and velocity, the
+	voice it got (and whether it was stolen), hits on samples that haven't loaded, and changes of
+	light state.
+
+	The audio thread doesn't print. It pushes a fixed-size record (type, pad, frame, a voice or
+	state and up to two values) onto a wait-free queue (spscQueue.hpp) and, at the end of the
+	block, schedules an auxiliary task if there's anything in it. The task formats the records
+	and prints them, and appends them to eventLogFile if there is one. If the queue is full the
+	event is dropped and counted, and the task says how many it missed.
+
+	Events are stamped with the frame render() was on (EVENT_LOG_FRAME, every frame), so
+	functions deep in the trigger path don't need to be passed it.
+
+	Define DISABLE_EVENT_LOG in defs.hpp to take it out of render() altogether; the EVENT_
+	macros are then empty.
+*/
+
+#ifndef DISABLE_EVENT_LOG
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+#include "spscQueue.hpp"
+
+#define EVENT_LOG_QUEUE_SIZE 256	// Events per drain; a block with more than this loses some
+
+int eventLogToConsole = 1;			// Set to 0 to only write eventLogFile
+const char *eventLogFile = NULL;	// e.g. "events.log" to also keep them in a file
+int eventLogWaitMs = 2000;			// How long cleanup waits for a drain that's under way
+
+enum {
+	kEventHit = 0,			// values: piezo peak, velocity
+	kEventVoice,			// index: the voice; values[0]: 1 if it was stolen
+	kEventSampleNotReady,
+	kEventLightState,		// index: the new state
+};
+
+struct LogEvent {
+	uint64_t frame;
+	uint8_t type;
+	int8_t pad;
+	int16_t index;
+	float values[2];
+};
+
+SpscQueue<LogEvent, EVENT_LOG_QUEUE_SIZE> gEventQueue;
+std::atomic<unsigned int> gEventsDropped(0);
+unsigned int gEventsDroppedReported = 0;
+std::atomic<bool> gEventDrainBusy(false);	// From scheduling the task until it has drained
+std::atomic<bool> gEventDraining(false);	// Held by whoever is reading the queue
+uint64_t gEventFrame = 0;
+float gEventSampleRate = 44100;
+FILE *gEventFile = NULL;
+AuxiliaryTask gEventTask;
+
+void drainEventLog();
+
+void eventLogSetup(BelaContext *context) {
+	gEventSampleRate = context->audioSampleRate;
+	if (eventLogFile) {
+		gEventFile = fopen(eventLogFile, "a");
+		if (!gEventFile)
+			rt_printf("Couldn't open %s for the event log\n", eventLogFile);
+	}
+	gEventTask = Bela_createAuxiliaryTask(drainEventLog, 20, "bela-events");
+}
+
+// Audio thread. Only this thread pushes, so the drop count needs no read-modify-write.
+static inline void eventLogPush(int type, int pad, int index, float value0, float value1) {
+	LogEvent event = { gEventFrame, (uint8_t)type, (int8_t)pad, (int16_t)index, { value0, value1 } };
+	if (!gEventQueue.push(event))
+		gEventsDropped.store(gEventsDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static inline void eventLogBlockEnd() {
+	if (gEventQueue.size() > 0 && !gEventDrainBusy.load(std::memory_order_acquire)) {
+		gEventDrainBusy.store(true, std::memory_order_release);
+		Bela_scheduleAuxiliaryTask(gEventTask);
+	}
+}
+
+static void formatEvent(const LogEvent& event, char *line, int size) {
+	double seconds = event.frame / gEventSampleRate;
+	switch (event.type) {
+	case kEventHit:
+		snprintf(line, size, "%.3fs pad %d hit: piezo peak %f, velocity %f\n", seconds, event.pad,
+			event.values[0], event.values[1]);
+		break;
+	case kEventVoice:
+		snprintf(line, size, "%.3fs pad %d %s voice %d\n", seconds, event.pad,
+			event.values[0] ? "stole" : "found a loose", event.index);
+		break;
+	case kEventSampleNotReady:
+		snprintf(line, size, "%.3fs pad %d: sample isn't loaded yet\n", seconds, event.pad);
+		break;
+	case kEventLightState:
+		snprintf(line, size, "%.3fs light state moved to %d\n", seconds, event.index);
+		break;
+	default:
+		snprintf(line, size, "%.3fs unknown event %d\n", seconds, event.type);
+	}
+}
+
+static void writeEventLine(const char *line) {
+	if (eventLogToConsole)
+		rt_printf("%s", line);
+	if (gEventFile)
+		fputs(line, gEventFile);
+}
+
+// Prints everything in the queue. Only whoever holds gEventDraining may call this.
+static void drainEvents() {
+	char line[128];
+	LogEvent event;
+	while (gEventQueue.pop(event)) {
+		formatEvent(event, line, sizeof(line));
+		writeEventLine(line);
+	}
+	unsigned int dropped = gEventsDropped.load(std::memory_order_relaxed);
+	if (dropped != gEventsDroppedReported) {
+		snprintf(line, sizeof(line), "(event log full: %u events dropped so far)\n", dropped);
+		writeEventLine(line);
+		gEventsDroppedReported = dropped;
+	}
+	if (gEventFile)
+		fflush(gEventFile);
+}
+
+// Auxiliary task. Leaves the queue alone if cleanup has taken it.
+void drainEventLog() {
+	if (gEventDraining.exchange(true, std::memory_order_acq_rel))
+		return;
+	drainEvents();
+	gEventDraining.store(false, std::memory_order_release);
+	gEventDrainBusy.store(false, std::memory_order_release);
+}
+
+// After the audio thread has stopped: take the queue from the task for good (waiting for a drain
+// that's under way), print what's left and close the file.
+void eventLogCleanup() {
+	for (int waited = 0; gEventDraining.exchange(true, std::memory_order_acq_rel); waited++) {
+		if (waited >= eventLogWaitMs) {
+			rt_printf("The event log task didn't finish; leaving its file open\n");
+			return;
+		}
+		usleep(1000);
+	}
+	drainEvents();
+	if (gEventFile) {
+		fclose(gEventFile);
+		gEventFile = NULL;
+	}
+}
+
+#define EVENT_LOG_SETUP(context) eventLogSetup(context)
+#define EVENT_LOG_FRAME(frame) (gEventFrame = (frame))
+#define EVENT_HIT(pad, peak, velocity) eventLogPush(kEventHit, pad, 0, peak, velocity)
+#define EVENT_VOICE(pad, voice, stole) eventLogPush(kEventVoice, pad, voice, (stole) ? 1 : 0, 0)
+#define EVENT_SAMPLE_NOT_READY(pad) eventLogPush(kEventSampleNotReady, pad, 0, 0, 0)
+#define EVENT_LIGHT_STATE(state) eventLogPush(kEventLightState, -1, state, 0, 0)
+#define EVENT_LOG_BLOCK_END() eventLogBlockEnd()
+#define EVENT_LOG_CLEANUP() eventLogCleanup()
+
+#else
+
+#define EVENT_LOG_SETUP(context)
+#define EVENT_LOG_FRAME(frame)
+#define EVENT_HIT(pad, peak, velocity)
+#define EVENT_VOICE(pad, voice, stole)
+#define EVENT_SAMPLE_NOT_READY(pad)
+#define EVENT_LIGHT_STATE(state)
+#define EVENT_LOG_BLOCK_END()
+#define EVENT_LOG_CLEANUP()
+
+#endif /* DISABLE_EVENT_LOG */
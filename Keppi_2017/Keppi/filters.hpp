@@ -0,0 +1,251 @@
+/***** filters.hpp *****/
+/*
+	Filters for the sensor inputs: a biquad, a DC blocker and a one-pole lowpass.
+
+	Each is templated on its sample type T (float, or double where the signal needs it, like
+	the accelerometer) and its number of channels N. Every channel has its own state and they
+	all share the coefficients, so the channels are filtered side by side in SIMD lanes: four
+	floats at a time with NEON or SSE, two doubles with SSE2 (the board's NEON doesn't do
+	doubles, so those are scalar there). Channels left over after the last full vector are
+	done one at a time.
+
+	process() filters a run of frames. Frame f of channel c is read from in[f * inStride + c]
+	and written to out[f * outStride + c], so the input can be straight from
+	context->analogIn (with inStride = context->analogInChannels). The input can be float
+	even when the filter is double.
+
+	Left alone, the state of a filter fed silence decays into denormals, which are very slow
+	on some CPUs. At the end of every process() call, state smaller than the smallest normal
+	number is set to zero. Normal values are never touched, so results are otherwise exactly
+	as computed. (NEON flushes denormals itself.)
+
+	The testers in Testing library/ that use it keep copies, as each Bela project has to be
+	self-contained. Edit this one and copy it over them: make check (in host/) fails if a
+	copy differs.
+*/
+
+#ifndef FILTERS_HPP_
+#define FILTERS_HPP_
+
+#include <cmath>
+#include <limits>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+// One channel at a time.
+template <typename T>
+struct FilterScalarOps {
+	typedef T Vec;
+	static const int kWidth = 1;
+	static inline Vec load(const float *p) { return (T)*p; }
+	static inline Vec load(const double *p) { return (T)*p; }
+	static inline void store(T *p, Vec a) { *p = a; }
+	static inline Vec set1(T x) { return x; }
+	static inline Vec add(Vec a, Vec b) { return a + b; }
+	static inline Vec sub(Vec a, Vec b) { return a - b; }
+	static inline Vec mul(Vec a, Vec b) { return a * b; }
+	static inline Vec abs(Vec a) { return std::fabs(a); }
+	static inline Vec flush(Vec a) { return std::fabs(a) < std::numeric_limits<T>::min() ? 0 : a; }
+};
+
+// As many channels at a time as fit in a vector (one, where there's no SIMD for T).
+template <typename T>
+struct FilterSimdOps : FilterScalarOps<T> {};
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+template <>
+struct FilterSimdOps<float> {
+	typedef float32x4_t Vec;
+	static const int kWidth = 4;
+	static inline Vec load(const float *p) { return vld1q_f32(p); }
+	static inline Vec load(const double *p) {
+		float f[4] = { (float)p[0], (float)p[1], (float)p[2], (float)p[3] };
+		return vld1q_f32(f);
+	}
+	static inline void store(float *p, Vec a) { vst1q_f32(p, a); }
+	static inline Vec set1(float x) { return vdupq_n_f32(x); }
+	static inline Vec add(Vec a, Vec b) { return vaddq_f32(a, b); }
+	static inline Vec sub(Vec a, Vec b) { return vsubq_f32(a, b); }
+	static inline Vec mul(Vec a, Vec b) { return vmulq_f32(a, b); }
+	static inline Vec abs(Vec a) { return vabsq_f32(a); }
+	static inline Vec flush(Vec a) {
+		uint32x4_t normal = vcageq_f32(a, vdupq_n_f32(std::numeric_limits<float>::min()));
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), normal));
+	}
+};
+#elif defined(__SSE__)
+template <>
+struct FilterSimdOps<float> {
+	typedef __m128 Vec;
+	static const int kWidth = 4;
+	static inline Vec load(const float *p) { return _mm_loadu_ps(p); }
+	static inline Vec load(const double *p) { return _mm_setr_ps(p[0], p[1], p[2], p[3]); }
+	static inline void store(float *p, Vec a) { _mm_storeu_ps(p, a); }
+	static inline Vec set1(float x) { return _mm_set1_ps(x); }
+	static inline Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+	static inline Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+	static inline Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+	static inline Vec abs(Vec a) { return _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF))); }
+	static inline Vec flush(Vec a) { return _mm_and_ps(a, _mm_cmpge_ps(abs(a), _mm_set1_ps(std::numeric_limits<float>::min()))); }
+};
+
+#if defined(__SSE2__)
+template <>
+struct FilterSimdOps<double> {
+	typedef __m128d Vec;
+	static const int kWidth = 2;
+	static inline Vec load(const float *p) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)p))); }
+	static inline Vec load(const double *p) { return _mm_loadu_pd(p); }
+	static inline void store(double *p, Vec a) { _mm_storeu_pd(p, a); }
+	static inline Vec set1(double x) { return _mm_set1_pd(x); }
+	static inline Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+	static inline Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+	static inline Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+	static inline Vec abs(Vec a) { return _mm_and_pd(a, _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL))); }
+	static inline Vec flush(Vec a) { return _mm_and_pd(a, _mm_cmpge_pd(abs(a), _mm_set1_pd(std::numeric_limits<double>::min()))); }
+};
+#endif
+#endif
+
+// Runs filter.template processLanes<Ops>(c, ...) over all N channels, a vector's worth at a time.
+#define FILTER_FOR_EACH_LANE(T, N, call) \
+	do { \
+		int c = 0; \
+		for (; c + FilterSimdOps<T>::kWidth <= N; c += FilterSimdOps<T>::kWidth) \
+			this->template call<FilterSimdOps<T> >(c, in, inStride, out, outStride, frames); \
+		for (; c < N; c++) \
+			this->template call<FilterScalarOps<T> >(c, in, inStride, out, outStride, frames); \
+	} while (0)
+
+// Biquad, direct form I: y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+template <typename T, int N>
+struct Biquad {
+	T b0, b1, b2, a1, a2;
+	T x1[N], x2[N], y1[N], y2[N];	// Past inputs and outputs of each channel
+
+	Biquad() : b0(1), b1(0), b2(0), a1(0), a2(0) {
+		reset();
+	}
+
+	void setCoefficients(T newB0, T newB1, T newB2, T newA1, T newA2) {
+		b0 = newB0; b1 = newB1; b2 = newB2; a1 = newA1; a2 = newA2;
+	}
+
+	void reset() {
+		for (int c = 0; c < N; c++)
+			x1[c] = x2[c] = y1[c] = y2[c] = 0;
+	}
+
+	template <typename In>
+	void process(const In *in, int inStride, T *out, int outStride, int frames) {
+		FILTER_FOR_EACH_LANE(T, N, processLanes);
+	}
+
+	template <class Ops, typename In>
+	inline void processLanes(int c, const In *in, int inStride, T *out, int outStride, int frames) {
+		typedef typename Ops::Vec Vec;
+		Vec vb0 = Ops::set1(b0), vb1 = Ops::set1(b1), vb2 = Ops::set1(b2), va1 = Ops::set1(a1), va2 = Ops::set1(a2);
+		Vec vx1 = Ops::load(x1 + c), vx2 = Ops::load(x2 + c), vy1 = Ops::load(y1 + c), vy2 = Ops::load(y2 + c);
+		for (int f = 0; f < frames; f++) {
+			Vec x = Ops::load(in + f * inStride + c);
+			Vec y = Ops::sub(Ops::sub(Ops::add(Ops::add(Ops::mul(vb0, x), Ops::mul(vb1, vx1)), Ops::mul(vb2, vx2)),
+				Ops::mul(va1, vy1)), Ops::mul(va2, vy2));
+			Ops::store(out + f * outStride + c, y);
+			vx2 = vx1; vx1 = x;
+			vy2 = vy1; vy1 = y;
+		}
+		Ops::store(x1 + c, Ops::flush(vx1));
+		Ops::store(x2 + c, Ops::flush(vx2));
+		Ops::store(y1 + c, Ops::flush(vy1));
+		Ops::store(y2 + c, Ops::flush(vy2));
+	}
+};
+
+// DC blocker: y[n] = x[n] - x[n-1] + R y[n-1]
+template <typename T, int N>
+struct DCBlocker {
+	T r;
+	T x1[N], y1[N];		// Last input and output of each channel
+
+	DCBlocker() : r(0.995) {
+		reset();
+	}
+
+	void setup(T newR) {
+		r = newR;
+		reset();
+	}
+
+	void reset() {
+		for (int c = 0; c < N; c++)
+			x1[c] = y1[c] = 0;
+	}
+
+	template <typename In>
+	void process(const In *in, int inStride, T *out, int outStride, int frames) {
+		FILTER_FOR_EACH_LANE(T, N, processLanes);
+	}
+
+	template <class Ops, typename In>
+	inline void processLanes(int c, const In *in, int inStride, T *out, int outStride, int frames) {
+		typedef typename Ops::Vec Vec;
+		Vec vr = Ops::set1(r);
+		Vec vx1 = Ops::load(x1 + c), vy1 = Ops::load(y1 + c);
+		for (int f = 0; f < frames; f++) {
+			Vec x = Ops::load(in + f * inStride + c);
+			Vec y = Ops::add(Ops::sub(x, vx1), Ops::mul(vr, vy1));
+			Ops::store(out + f * outStride + c, y);
+			vx1 = x;
+			vy1 = y;
+		}
+		Ops::store(x1 + c, Ops::flush(vx1));
+		Ops::store(y1 + c, Ops::flush(vy1));
+	}
+};
+
+// One-pole lowpass: y[n] = y[n-1] + a (x[n] - y[n-1])
+template <typename T, int N>
+struct OnePole {
+	T a;
+	T y1[N];			// Last output of each channel
+
+	OnePole() : a(1) {
+		reset();
+	}
+
+	// a for a -3dB point of cutoff Hz.
+	void setCutoff(T cutoff, T sampleRate) {
+		a = 1 - std::exp(-2 * (T)M_PI * cutoff / sampleRate);
+	}
+
+	void reset() {
+		for (int c = 0; c < N; c++)
+			y1[c] = 0;
+	}
+
+	template <typename In>
+	void process(const In *in, int inStride, T *out, int outStride, int frames) {
+		FILTER_FOR_EACH_LANE(T, N, processLanes);
+	}
+
+	template <class Ops, typename In>
+	inline void processLanes(int c, const In *in, int inStride, T *out, int outStride, int frames) {
+		typedef typename Ops::Vec Vec;
+		Vec va = Ops::set1(a);
+		Vec vy1 = Ops::load(y1 + c);
+		for (int f = 0; f < frames; f++) {
+			Vec x = Ops::load(in + f * inStride + c);
+			vy1 = Ops::add(vy1, Ops::mul(va, Ops::sub(x, vy1)));
+			Ops::store(out + f * outStride + c, vy1);
+		}
+		Ops::store(y1 + c, Ops::flush(vy1));
+	}
+};
+
+#undef FILTER_FOR_EACH_LANE
+
+#endif /* FILTERS_HPP_ */
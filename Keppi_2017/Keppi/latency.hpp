@@ -0,0 +1,215 @@
+/***** latency.hpp *****/
+/*
+	Touch-to-sound latency, in audio frames, for every hit on every pad.
+
+	Each hit is stamped as it goes down the chain:
+	- poll: the frame the MPR121 read that saw the touch was scheduled
+	- touch: the frame render() handled the touch event (gSensorState set to 1)
+	- window: the frame the piezo window had collected NUM_PIEZO_VALUES_FRONT samples
+	- voice: the frame startPlayingSample() started the voice
+	- sound: the first frame the voice writes a nonzero sample. Samples can start with
+	  silence, so this is the voice frame plus the leading zeros of its sample (counted as it loads)
+	  that it doesn't skip.
+	The time from the touch itself to the poll is up to one read interval (or the chip's 1ms
+	sample period in interrupt mode) and can't be seen from here.
+
+	Define ENABLE_LATENCY_TRACE in defs.hpp to switch it on; otherwise the LATENCY_ macros are empty.
+	The audio thread only adds to fixed-size histograms, one per pad and step. Every few seconds
+	(if anything was hit) they are swapped with a spare set, and an auxiliary task prints the
+	mean, 99th percentile and max of each step in ms.
+*/
+
+#ifdef ENABLE_LATENCY_TRACE
+
+#include <atomic>
+#include <cstring>
+
+#define LATENCY_BIN_FRAMES 8		// Histogram resolution
+#define LATENCY_NUM_BINS 256		// Up to 2048 frames (46ms); the last bin takes anything longer
+#define LATENCY_REPORT_SECONDS 5
+
+enum {
+	kLatencyPollToTouch = 0,
+	kLatencyTouchToWindow,
+	kLatencyWindowToVoice,
+	kLatencyVoiceToSound,
+	kLatencyTotal,
+	kNumLatencySteps
+};
+
+const char *gLatencyStepNames[kNumLatencySteps] = {
+	"poll->touch", "touch->window", "window->voice", "voice->sound", "poll->sound"
+};
+
+struct LatencyStats {
+	uint32_t histogram[NUM_TOUCH_PINS][kNumLatencySteps][LATENCY_NUM_BINS];
+	uint32_t max[NUM_TOUCH_PINS][kNumLatencySteps];
+	uint64_t sum[NUM_TOUCH_PINS][kNumLatencySteps];
+	uint32_t numHits[NUM_TOUCH_PINS];
+	uint32_t numMuted;		// Hits that got to the end of the window while muted (or before their sample loaded)
+};
+
+// The stamps of the hit in flight on each pad (one at a time, like the sensor state machine).
+struct LatencyTrace {
+	uint64_t poll;
+	uint64_t touch;
+	uint64_t window;
+	bool active;
+};
+
+extern SampleData gSampleData[NUM_SAMPLES];
+
+// Two sets: the audio thread fills one while the report task reads the other.
+LatencyStats gLatencyStats[2];
+int gLatencyActive = 0;
+std::atomic<bool> gLatencyReportBusy(false);
+
+LatencyTrace gLatencyTraces[NUM_TOUCH_PINS];
+int gLeadingSilence[NUM_SAMPLES];	// Frames of zeros at the start of each sample
+uint64_t gLatencyNextReport = 0;
+int gLatencyReportFrames = 1;
+float gLatencySampleRate = 44100;
+AuxiliaryTask gLatencyTask;
+
+void printLatencyReport();
+
+void latencySetup(BelaContext *context) {
+	memset(gLatencyStats, 0, sizeof(gLatencyStats));
+	memset(gLatencyTraces, 0, sizeof(gLatencyTraces));
+	gLatencySampleRate = context->audioSampleRate;
+	gLatencyReportFrames = LATENCY_REPORT_SECONDS * context->audioSampleRate;
+	gLatencyNextReport = gLatencyReportFrames;
+	gLatencyTask = Bela_createAuxiliaryTask(printLatencyReport, 10, "bela-latency");
+}
+
+// Loader: sample i has loaded. Count its leading zeros before the audio thread can play it.
+void latencySampleReady(int i) {
+	int n = 0;
+	if (gSampleData[i].samples16) {
+		while (n < gSampleData[i].residentLen && gSampleData[i].samples16[n] == 0)
+			n++;
+	} else {
+		while (n < gSampleData[i].residentLen && gSampleData[i].samples[n] == 0)
+			n++;
+	}
+	gLeadingSilence[i] = n;
+}
+
+static inline void latencyAdd(LatencyStats *stats, int pad, int step, uint64_t frames) {
+	int bin = frames / LATENCY_BIN_FRAMES;
+	if (bin >= LATENCY_NUM_BINS)
+		bin = LATENCY_NUM_BINS - 1;
+	stats->histogram[pad][step][bin]++;
+	stats->sum[pad][step] += frames;
+	if (frames > stats->max[pad][step])
+		stats->max[pad][step] = frames;
+}
+
+// A touch event was handled. A second touch before the window completes starts the trace
+// again, as it restarts the window.
+static inline void latencyTouch(int pad, uint64_t pollFrame, uint64_t frame) {
+	gLatencyTraces[pad].poll = pollFrame;
+	gLatencyTraces[pad].touch = frame;
+	gLatencyTraces[pad].active = true;
+}
+
+static inline void latencyWindow(int pad, uint64_t frame) {
+	gLatencyTraces[pad].window = frame;
+}
+
+// The hit's voice started on this frame playing buffer from startFrame (or didn't, if muted):
+// file the trace.
+static inline void latencyVoice(int pad, int buffer, int startFrame, bool started, uint64_t frame) {
+	LatencyTrace *trace = &gLatencyTraces[pad];
+	if (!trace->active)
+		return;
+	trace->active = false;
+
+	LatencyStats *stats = &gLatencyStats[gLatencyActive];
+	if (!started) {
+		stats->numMuted++;
+		return;
+	}
+	uint64_t sound = frame;
+	if (startFrame < gLeadingSilence[buffer])
+		sound += gLeadingSilence[buffer] - startFrame;
+	latencyAdd(stats, pad, kLatencyPollToTouch, trace->touch - trace->poll);
+	latencyAdd(stats, pad, kLatencyTouchToWindow, trace->window - trace->touch);
+	latencyAdd(stats, pad, kLatencyWindowToVoice, frame - trace->window);
+	latencyAdd(stats, pad, kLatencyVoiceToSound, sound - frame);
+	latencyAdd(stats, pad, kLatencyTotal, sound - trace->poll);
+	stats->numHits[pad]++;
+}
+
+static inline void latencyBlockEnd(uint64_t framesElapsed) {
+	if (framesElapsed < gLatencyNextReport)
+		return;
+	gLatencyNextReport = framesElapsed + gLatencyReportFrames;
+
+	LatencyStats *stats = &gLatencyStats[gLatencyActive];
+	bool anyHits = stats->numMuted > 0;
+	for (int p = 0; p < NUM_TOUCH_PINS; p++)
+		anyHits = anyHits || stats->numHits[p] > 0;
+	// Hand the set over if there's something in it and the last report has been printed.
+	if (anyHits && !gLatencyReportBusy.load(std::memory_order_acquire)) {
+		gLatencyActive = !gLatencyActive;
+		gLatencyReportBusy.store(true, std::memory_order_release);
+		Bela_scheduleAuxiliaryTask(gLatencyTask);
+	}
+}
+
+// Auxiliary task: prints the set the audio thread isn't using, then clears it.
+void printLatencyReport() {
+	LatencyStats *stats = &gLatencyStats[!gLatencyActive];
+	float msPerFrame = 1000.0 / gLatencySampleRate;
+
+	rt_printf("---- touch-to-sound latency (ms) ----\n");
+	for (int p = 0; p < NUM_TOUCH_PINS; p++) {
+		uint32_t hits = stats->numHits[p];
+		if (hits == 0)
+			continue;
+		rt_printf("pad %d, %u hits:\n", p, hits);
+		rt_printf("  %-14s %8s %8s %8s\n", "step", "mean", "p99", "max");
+		for (int s = 0; s < kNumLatencySteps; s++) {
+			uint32_t target = hits - hits / 100;
+			uint32_t count = 0;
+			int p99 = 0;
+			for (int b = 0; b < LATENCY_NUM_BINS; b++) {
+				count += stats->histogram[p][s][b];
+				if (count >= target) {
+					p99 = b;
+					break;
+				}
+			}
+			// The upper edge of the bin (so p99 errs on the long side), but no more than the max.
+			uint32_t p99Frames = (p99 + 1) * LATENCY_BIN_FRAMES;
+			if (p99Frames > stats->max[p][s])
+				p99Frames = stats->max[p][s];
+			rt_printf("  %-14s %8.2f %8.2f %8.2f\n", gLatencyStepNames[s],
+				msPerFrame * stats->sum[p][s] / hits, msPerFrame * p99Frames, msPerFrame * stats->max[p][s]);
+		}
+	}
+	if (stats->numMuted)
+		rt_printf("(%u hits while muted or loading)\n", stats->numMuted);
+
+	memset(stats, 0, sizeof(LatencyStats));
+	gLatencyReportBusy.store(false, std::memory_order_release);
+}
+
+#define LATENCY_SETUP(context) latencySetup(context)
+#define LATENCY_SAMPLE_READY(sample) latencySampleReady(sample)
+#define LATENCY_TOUCH(pad, pollFrame, frame) latencyTouch(pad, pollFrame, frame)
+#define LATENCY_WINDOW(pad, frame) latencyWindow(pad, frame)
+#define LATENCY_VOICE(pad, buffer, startFrame, started, frame) latencyVoice(pad, buffer, startFrame, started, frame)
+#define LATENCY_BLOCK_END(framesElapsed) latencyBlockEnd(framesElapsed)
+
+#else
+
+#define LATENCY_SETUP(context)
+#define LATENCY_SAMPLE_READY(sample)
+#define LATENCY_TOUCH(pad, pollFrame, frame)
+#define LATENCY_WINDOW(pad, frame)
+#define LATENCY_VOICE(pad, buffer, startFrame, started, frame) ((void)(started))
+#define LATENCY_BLOCK_END(framesElapsed)
+
+#endif /* ENABLE_LATENCY_TRACE */
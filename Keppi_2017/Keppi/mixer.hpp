@@ -0,0 +1,282 @@
+/***** mixer.hpp *****/
+/*
+	Renders the sounding voices a block at a time.
+
+	Rather than visiting every voice on every frame, each voice is mixed across a run of
+	frames in one tight loop: we work out once how many frames are left before its sample
+	ends, multiply-accumulate that many samples (four at a time with NEON on the board,
+	SSE/AVX on the host) and advance its read pointer in one go.
+
+	render() mixes up to the frame where a new voice starts before starting it, so voices
+	still begin (and get stolen) on the exact frame they were triggered.
+
+	Samples stored as 16 bit are converted and scaled inside the same loop (eight at a time),
+	so they cost half the memory and cache without a separate conversion pass.
+
+	Voices whose sample is streamed from disk are mixed from their ring buffer once they're
+	past the resident head (see streaming.hpp).
+
+	A voice with a rate other than 1 (tuned, pitched by velocity, or a sample recorded at
+	another sample rate) reads its sample at fractional positions, interpolated linearly or
+	with a 4-point cubic (Hermite) as interpolationQuality says. The positions and the sample
+	frames around them are worked out one frame at a time, then the interpolation is done
+	four frames at a time. host/interp_bench times each quality per voice.
+	Voices at rate 1 don't interpolate at all, so they sound (and cost) the same as ever.
+*/
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#define MIX_GAIN 1.2 // Applied to every voice on the way into the mix
+
+enum {
+	kInterpolationLinear = 0,
+	kInterpolationCubic
+};
+
+int interpolationQuality = kInterpolationCubic; // For voices that don't play at rate 1
+
+extern VoicePool gVoices;
+extern SampleData gSampleData[NUM_SAMPLES];
+extern int useStreaming;
+
+static inline void mixVoiceBlock(float *out, const float *in, float gain, int count);
+void mixStreamingVoice(int v, SampleData *sample, float *out, float gain, int count);
+void mixStreamingVoiceResampled(int v, SampleData *sample, float *out, float gain, int count);
+void streamStop(int v);
+
+float *gMixBuffer;	// One block of mixed voices, allocated in setup()
+int gMixedFrames = 0; // How far into this block we've mixed
+
+// out[n] += in[n] * gain, for n < count
+static inline void mixVoiceBlock(float *out, const float *in, float gain, int count) {
+	int n = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	float32x4_t g = vdupq_n_f32(gain);
+	for (; n + 4 <= count; n += 4) {
+		vst1q_f32(out + n, vmlaq_f32(vld1q_f32(out + n), vld1q_f32(in + n), g));
+	}
+#elif defined(__AVX__)
+	__m256 g = _mm256_set1_ps(gain);
+	for (; n + 8 <= count; n += 8) {
+		_mm256_storeu_ps(out + n, _mm256_add_ps(_mm256_loadu_ps(out + n), _mm256_mul_ps(_mm256_loadu_ps(in + n), g)));
+	}
+#elif defined(__SSE__)
+	__m128 g = _mm_set1_ps(gain);
+	for (; n + 4 <= count; n += 4) {
+		_mm_storeu_ps(out + n, _mm_add_ps(_mm_loadu_ps(out + n), _mm_mul_ps(_mm_loadu_ps(in + n), g)));
+	}
+#endif
+	for (; n < count; n++) {
+		out[n] += in[n] * gain;
+	}
+}
+
+// out[n] += in[n] * gain, for n < count, with 16-bit input (fold SAMPLE_INT16_SCALE into gain)
+static inline void mixVoiceBlock16(float *out, const int16_t *in, float gain, int count) {
+	int n = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	float32x4_t g = vdupq_n_f32(gain);
+	for (; n + 8 <= count; n += 8) {
+		int16x8_t s = vld1q_s16(in + n);
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+		vst1q_f32(out + n, vmlaq_f32(vld1q_f32(out + n), lo, g));
+		vst1q_f32(out + n + 4, vmlaq_f32(vld1q_f32(out + n + 4), hi, g));
+	}
+#elif defined(__AVX2__)
+	__m256 g = _mm256_set1_ps(gain);
+	for (; n + 8 <= count; n += 8) {
+		__m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + n))));
+		_mm256_storeu_ps(out + n, _mm256_add_ps(_mm256_loadu_ps(out + n), _mm256_mul_ps(s, g)));
+	}
+#elif defined(__SSE2__)
+	__m128 g = _mm_set1_ps(gain);
+	for (; n + 8 <= count; n += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in + n));
+		// Sign-extend to 32 bits: put each sample in the top half and shift it down.
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+		_mm_storeu_ps(out + n, _mm_add_ps(_mm_loadu_ps(out + n), _mm_mul_ps(lo, g)));
+		_mm_storeu_ps(out + n + 4, _mm_add_ps(_mm_loadu_ps(out + n + 4), _mm_mul_ps(hi, g)));
+	}
+#endif
+	for (; n < count; n++) {
+		out[n] += in[n] * gain;
+	}
+}
+
+// A resident run of a voice's sample, whichever way it's stored.
+static inline void mixSampleBlock(float *out, const SampleData *sample, int start, float gain, int count) {
+	if (sample->samples16)
+		mixVoiceBlock16(out, sample->samples16 + start, gain * SAMPLE_INT16_SCALE, count);
+	else
+		mixVoiceBlock(out, sample->samples + start, gain, count);
+}
+
+static inline float interpolateLinear(float x0, float x1, float t) {
+	return x0 + t * (x1 - x0);
+}
+
+static inline float interpolateCubic(float xm1, float x0, float x1, float x2, float t) {
+	float c1 = 0.5f * (x1 - xm1);
+	float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+	float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+	return ((c3 * t + c2) * t + c1) * t + x0;
+}
+
+// out[k] += gain * (the frame interpolated from xm1[k] ... x2[k] at t[k]), for k < 4
+static inline void interpolate4(float *out, const float *xm1, const float *x0, const float *x1, const float *x2,
+	const float *t, float gain, int quality) {
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	float32x4_t a = vld1q_f32(x0), b = vld1q_f32(x1), tt = vld1q_f32(t);
+	float32x4_t y;
+	if (quality == kInterpolationCubic) {
+		float32x4_t am = vld1q_f32(xm1), c = vld1q_f32(x2);
+		float32x4_t c1 = vmulq_n_f32(vsubq_f32(b, am), 0.5f);
+		float32x4_t c2 = vsubq_f32(vmlaq_n_f32(vmlsq_n_f32(am, a, 2.5f), b, 2.0f), vmulq_n_f32(c, 0.5f));
+		float32x4_t c3 = vmlaq_n_f32(vmulq_n_f32(vsubq_f32(c, am), 0.5f), vsubq_f32(a, b), 1.5f);
+		y = vmlaq_f32(a, vmlaq_f32(c1, vmlaq_f32(c2, c3, tt), tt), tt);
+	} else {
+		y = vmlaq_f32(a, vsubq_f32(b, a), tt);
+	}
+	vst1q_f32(out, vmlaq_n_f32(vld1q_f32(out), y, gain));
+#elif defined(__SSE__)
+	__m128 a = _mm_loadu_ps(x0), b = _mm_loadu_ps(x1), tt = _mm_loadu_ps(t);
+	__m128 y;
+	if (quality == kInterpolationCubic) {
+		__m128 am = _mm_loadu_ps(xm1), c = _mm_loadu_ps(x2);
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 c1 = _mm_mul_ps(_mm_sub_ps(b, am), half);
+		__m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(am, _mm_mul_ps(a, _mm_set1_ps(2.5f))), _mm_add_ps(b, b)), _mm_mul_ps(c, half));
+		__m128 c3 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(c, am), half), _mm_mul_ps(_mm_sub_ps(a, b), _mm_set1_ps(1.5f)));
+		y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, tt), c2), tt), c1), tt), a);
+	} else {
+		y = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), tt));
+	}
+	_mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(y, _mm_set1_ps(gain))));
+#else
+	for (int k = 0; k < 4; k++) {
+		float y = quality == kInterpolationCubic ? interpolateCubic(xm1[k], x0[k], x1[k], x2[k], t[k])
+			: interpolateLinear(x0[k], x1[k], t[k]);
+		out[k] += y * gain;
+	}
+#endif
+}
+
+// Frame i of in (len frames long), or silence either side of it.
+template <typename T>
+static inline float frameOrSilence(const T *in, int len, int i) {
+	return i >= 0 && i < len ? (float)in[i] : 0.0f;
+}
+
+// Mix count frames of in (len frames long, float or 16 bit) read from start + phase onwards,
+// moving rate frames through in per frame of out.
+template <typename T>
+static inline void mixResampledBlock(float *out, const T *in, int len, int start, float phase, float rate,
+	float gain, int count, int quality) {
+	float xm1[4], x0[4], x1[4], x2[4], t[4];
+	int n = 0;
+	for (; n + 4 <= count; n += 4) {
+		for (int k = 0; k < 4; k++) {
+			double position = phase + (double)(n + k) * rate;
+			int i = (int)position;
+			t[k] = (float)(position - i);
+			i += start;
+			if (i >= 1 && i + 2 < len) {
+				xm1[k] = in[i - 1]; x0[k] = in[i]; x1[k] = in[i + 1]; x2[k] = in[i + 2];
+			} else {
+				xm1[k] = frameOrSilence(in, len, i - 1);
+				x0[k] = frameOrSilence(in, len, i);
+				x1[k] = frameOrSilence(in, len, i + 1);
+				x2[k] = frameOrSilence(in, len, i + 2);
+			}
+		}
+		interpolate4(out + n, xm1, x0, x1, x2, t, gain, quality);
+	}
+	for (; n < count; n++) {
+		double position = phase + (double)n * rate;
+		int i = (int)position;
+		float tn = (float)(position - i);
+		i += start;
+		float y;
+		if (quality == kInterpolationCubic) {
+			y = interpolateCubic(frameOrSilence(in, len, i - 1), frameOrSilence(in, len, i),
+				frameOrSilence(in, len, i + 1), frameOrSilence(in, len, i + 2), tn);
+		} else {
+			y = interpolateLinear(frameOrSilence(in, len, i), frameOrSilence(in, len, i + 1), tn);
+		}
+		out[n] += y * gain;
+	}
+}
+
+// mixSampleBlock() for a voice that isn't playing at rate 1.
+static inline void mixSampleResampled(float *out, const SampleData *sample, int start, float phase, float rate,
+	float gain, int count) {
+	if (sample->samples16)
+		mixResampledBlock(out, sample->samples16, sample->residentLen, start, phase, rate,
+			gain * SAMPLE_INT16_SCALE, count, interpolationQuality);
+	else
+		mixResampledBlock(out, sample->samples, sample->residentLen, start, phase, rate,
+			gain, count, interpolationQuality);
+}
+
+void mixerStartBlock(int numFrames) {
+	for (int n = 0; n < numFrames; n++) {
+		gMixBuffer[n] = 0;
+	}
+	gMixedFrames = 0;
+}
+
+// Mix every sounding voice from where we got to up to (not including) endFrame,
+// and stop the voices that reach the end of their sample.
+void mixVoicesUpTo(int endFrame) {
+	int numFrames = endFrame - gMixedFrames;
+	if (numFrames <= 0)
+		return;
+
+	// Walk the list backwards, as stopping a voice moves the last one into its place.
+	for (int a = gVoices.numActive - 1; a >= 0; a--) {
+		int v = gVoices.active[a];
+		SampleData *sample = &gSampleData[gVoices.bufferID[v]];
+		float gain = gVoices.velocity[v] * MIX_GAIN;
+
+		if (gVoices.rate[v] == 1.0f && gVoices.phase[v] == 0.0f) {
+			int framesLeft = sample->sampleLen - gVoices.readPointer[v];
+			int count = framesLeft < numFrames ? framesLeft : numFrames;
+			if (sample->residentLen == sample->sampleLen) {
+				mixSampleBlock(gMixBuffer + gMixedFrames, sample, gVoices.readPointer[v], gain, count);
+			} else {
+				mixStreamingVoice(v, sample, gMixBuffer + gMixedFrames, gain, count);
+			}
+			gVoices.readPointer[v] += count;
+		} else {
+			// Frames of output until the read position passes the end of the sample.
+			double framesLeft = ceil((sample->sampleLen - gVoices.readPointer[v] - gVoices.phase[v]) / gVoices.rate[v]);
+			int count = framesLeft < numFrames ? (int)framesLeft : numFrames;
+			if (count < 0)
+				count = 0;
+			if (sample->residentLen == sample->sampleLen) {
+				mixSampleResampled(gMixBuffer + gMixedFrames, sample, gVoices.readPointer[v], gVoices.phase[v],
+					gVoices.rate[v], gain, count);
+			} else {
+				mixStreamingVoiceResampled(v, sample, gMixBuffer + gMixedFrames, gain, count);
+			}
+			double position = gVoices.phase[v] + (double)count * gVoices.rate[v];
+			int advance = (int)position;
+			gVoices.readPointer[v] += advance;
+			gVoices.phase[v] = position - advance;
+		}
+
+		if (gVoices.readPointer[v] >= sample->sampleLen) {
+			gVoices.stop(v);
+			if (useStreaming) {
+				streamStop(v);
+			}
+		}
+	}
+	gMixedFrames = endFrame;
+}
@@ -1,30 +1,164 @@
 /***** readPiezos.hpp *****/
 
-void readPiezos(BelaContext *context, int frame);
+#include "filters.hpp"
 
+void readPiezos(BelaContext *context);
 
-// DC blocking variables:
-float gPiezoX[NUM_TOUCH_PINS] = { 0 };
-float gPiezoY[NUM_TOUCH_PINS] = { 0 };
+// Sliding window of piezo samples around a touch, with the peak kept up to date as we go.
+// Fixed size, so nothing allocates in the audio thread. Pushing and popping cost O(1)
+// (amortised) and max() is O(1): maxQueue holds the positions of the samples that could
+// still become the peak, in decreasing order of value, so the front is always the peak.
+#define PIEZO_WINDOW_SIZE 512 // Power of two, at least NUM_PIEZO_VALUES_BACK + NUM_PIEZO_VALUES_FRONT
+#define PIEZO_WINDOW_MASK (PIEZO_WINDOW_SIZE - 1)
 
-// Piezo handling variables:
-float gPiezoInput[NUM_TOUCH_PINS] = { 0 };
-float gCurrentSampleDCBlocked[NUM_TOUCH_PINS] = { 0 };
+struct PiezoWindow {
+	float values[PIEZO_WINDOW_SIZE];
+	unsigned int maxQueue[PIEZO_WINDOW_SIZE]; // Positions of peak candidates
+	unsigned int head, tail;				// Positions of the oldest and next sample
+	unsigned int maxHead, maxTail;
+	
+	void clear() {
+		head = tail = maxHead = maxTail = 0;
+	}
+	
+	int size() {
+		return tail - head;
+	}
+	
+	void popFront() {
+		if (head == tail)
+			return;
+		if (maxQueue[maxHead & PIEZO_WINDOW_MASK] == head)
+			maxHead++;
+		head++;
+	}
+	
+	void push(float value) {
+		// If we're full, the oldest sample goes.
+		if (size() == PIEZO_WINDOW_SIZE)
+			popFront();
+		// Anything smaller than the new sample can never be the peak again.
+		while (maxTail != maxHead && values[maxQueue[(maxTail - 1) & PIEZO_WINDOW_MASK] & PIEZO_WINDOW_MASK] < value)
+			maxTail--;
+		values[tail & PIEZO_WINDOW_MASK] = value;
+		maxQueue[maxTail++ & PIEZO_WINDOW_MASK] = tail;
+		tail++;
+	}
+	
+	float max() {
+		if (maxHead == maxTail)
+			return 0;
+		return values[maxQueue[maxHead & PIEZO_WINDOW_MASK] & PIEZO_WINDOW_MASK];
+	}
+	
+	// How many samples ago the peak came in (0: it's the newest).
+	int maxAge() {
+		if (maxHead == maxTail)
+			return 0;
+		return tail - 1 - maxQueue[maxHead & PIEZO_WINDOW_MASK];
+	}
+};
+
+// Peak picking: instead of always collecting NUM_PIEZO_VALUES_FRONT samples after a touch,
+// play as soon as the hit has clearly peaked:
+// - the peak is loud enough to be a hit (peakThreshold, before gScalerValues)
+// - nothing higher has come in for peakHoldFrames frames (the slope has turned)
+// - the envelope has decayed to peakDecayRatio of the peak
+// and in any case after peakMaxLatency frames, which bounds the wait (and is how quiet
+// touches still play). The velocity comes from the same window peak as before.
+// The envelope follows the rectified signal up instantly and decays with peakReleaseMs,
+// so the zero crossings of a ringing piezo don't look like the end of the hit.
+// With peakCompensateOffset, the sample starts as far in as the peak is old, so the
+// sound lines up with the hit rather than with when we noticed it.
+int usePeakPicking = 0;			// 0: wait for the full window, as before
+float peakThreshold = 0.002;
+int peakHoldFrames = 32;
+float peakDecayRatio = 0.5;
+float peakReleaseMs = 2;
+int peakMaxLatency = NUM_PIEZO_VALUES_FRONT; // No more than NUM_PIEZO_VALUES_FRONT
+int peakCompensateOffset = 0;
+
+float gPeakEnvelope[NUM_TOUCH_PINS] = { 0 };
+float gPeakRelease = 0.99;			// Per-frame envelope decay, set by setupPeakPicking()
+
+void setupPeakPicking(float sampleRate) {
+	gPeakRelease = expf(-1000.0 / (peakReleaseMs * sampleRate));
+	if (peakMaxLatency > NUM_PIEZO_VALUES_FRONT)
+		peakMaxLatency = NUM_PIEZO_VALUES_FRONT;
+}
+
+// Call with every sample pushed to the window, touched or not.
+static inline void trackPeakEnvelope(int sensor, float value) {
+	float decayed = gPeakEnvelope[sensor] * gPeakRelease;
+	gPeakEnvelope[sensor] = value > decayed ? value : decayed;
+}
+
+// Has the hit peaked? framesSinceTouch counts the samples collected since the touch.
+static inline bool peakPicked(int sensor, PiezoWindow& window, int framesSinceTouch) {
+	if (framesSinceTouch >= peakMaxLatency)
+		return true;
+	float peak = window.max();
+	return peak >= peakThreshold
+		&& window.maxAge() >= peakHoldFrames
+		&& gPeakEnvelope[sensor] <= peak * peakDecayRatio;
+}
 
 
+// The piezo front end: once a block, all four piezos (analog inputs 0-3) are DC blocked
+// together (see filters.hpp), then full-wave rectified into gPiezoBlock[piezo][analog frame]
+// for the sensor loop to read. Four frames at a time are transposed so each piezo's frames
+// land next to each other.
+#define PIEZO_DC_R 0.995f
 
-void readPiezos(BelaContext *context, int frame) {
+static_assert(NUM_TOUCH_PINS == 4, "readPiezos() has one SIMD lane per piezo");
+
+float *gPiezoBlock[NUM_TOUCH_PINS];	// One block of analog frames per piezo, allocated in setup()
+float *gPiezoFrames;				// The DC blocked block, a frame (all four piezos) at a time
+DCBlocker<float, NUM_TOUCH_PINS> gPiezoDC;
+
+void setupPiezos(BelaContext *context) {
+	for (int i = 0; i < NUM_TOUCH_PINS; i++) {
+		gPiezoBlock[i] = new float[context->analogFrames];
+	}
+	gPiezoFrames = new float[context->analogFrames * NUM_TOUCH_PINS];
+	gPiezoDC.setup(PIEZO_DC_R);
+}
+
+void cleanupPiezos() {
 	for (int i = 0; i < NUM_TOUCH_PINS; i++) {
-		gPiezoInput[i] = analogRead(context, frame/2, i);
-			    
-		// DC Offset Filter    y[n] = x[n] - x[n-1] + R * y[n-1]
-		gCurrentSampleDCBlocked[i] = gPiezoInput[i] - gPiezoX[i] + (0.995 * gPiezoY[i]);
-		gPiezoX[i] = gPiezoInput[i];
-		gPiezoY[i] = gCurrentSampleDCBlocked[i];
-			
-		// Full wave rectify
-		if(gCurrentSampleDCBlocked[i] < 0.0) {
-			gCurrentSampleDCBlocked[i] *= -1.0;
-		}
-	}
-}
\ No newline at end of file
+		delete[] gPiezoBlock[i];
+	}
+	delete[] gPiezoFrames;
+}
+
+void readPiezos(BelaContext *context) {
+	gPiezoDC.process(context->analogIn, context->analogInChannels, gPiezoFrames, NUM_TOUCH_PINS, context->analogFrames);
+
+	const float *in = gPiezoFrames;
+	unsigned int f = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for (; f + 4 <= context->analogFrames; f += 4) {
+		float32x4x2_t t0 = vtrnq_f32(vabsq_f32(vld1q_f32(in + f * 4)), vabsq_f32(vld1q_f32(in + f * 4 + 4)));
+		float32x4x2_t t1 = vtrnq_f32(vabsq_f32(vld1q_f32(in + f * 4 + 8)), vabsq_f32(vld1q_f32(in + f * 4 + 12)));
+		vst1q_f32(gPiezoBlock[0] + f, vcombine_f32(vget_low_f32(t0.val[0]), vget_low_f32(t1.val[0])));
+		vst1q_f32(gPiezoBlock[1] + f, vcombine_f32(vget_low_f32(t0.val[1]), vget_low_f32(t1.val[1])));
+		vst1q_f32(gPiezoBlock[2] + f, vcombine_f32(vget_high_f32(t0.val[0]), vget_high_f32(t1.val[0])));
+		vst1q_f32(gPiezoBlock[3] + f, vcombine_f32(vget_high_f32(t0.val[1]), vget_high_f32(t1.val[1])));
+	}
+#elif defined(__SSE__)
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	for (; f + 4 <= context->analogFrames; f += 4) {
+		__m128 rows[4];
+		for (int k = 0; k < 4; k++)
+			rows[k] = _mm_and_ps(_mm_loadu_ps(in + (f + k) * 4), absMask);
+		_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+		for (int i = 0; i < NUM_TOUCH_PINS; i++)
+			_mm_storeu_ps(gPiezoBlock[i] + f, rows[i]);
+	}
+#endif
+	// Whatever's left over (or everything, without SIMD).
+	for (; f < context->analogFrames; f++) {
+		for (int i = 0; i < NUM_TOUCH_PINS; i++)
+			gPiezoBlock[i][f] = fabsf(in[f * 4 + i]);
+	}
+}
@@ -1,40 +1,57 @@
 /***** play.hpp *****/
-int startPlayingSample(int sensor, float piezoValue);
+int startPlayingSample(int sensor, float piezoValue, int startFrame = 0);
+void streamStart(int v, int sample, int startFrame);
 
-extern int gReadPointers[NUM_VOICES];
-extern int gPointerState[NUM_VOICES];
-extern int gReadPointerBufferID[NUM_VOICES];
-extern int gReadPointerAge[NUM_VOICES];
-extern float gSampleVelocity[NUM_VOICES];
+extern VoicePool gVoices;
+extern SampleData gSampleData[NUM_SAMPLES];
+extern std::atomic<bool> gSampleReady[NUM_SAMPLES];
 extern int gSampleCount;
+extern int useStreaming;
 
-int startPlayingSample(int sensor, float piezoValue) {
+// Playback pitch. Out of the box every sample plays a frame per frame of output, which is how
+// the kit was voiced (the samples were recorded at 96kHz, so that's well below their real pitch).
+int playAtSourceRate = 0;		// Set to 1 to play samples at the rate they were recorded at
+float sampleTuning[NUM_SAMPLES] = {0, 0, 0, 0};	// Semitones up (or down) for each pad
+float velocityToPitch = 0;		// Semitones up per unit of velocity (which runs from 0.01 to 1.6)
+float gPlaybackSampleRate = 44100;	// Set in setup()
+
+// Starts a voice playing the sample for this sensor, stealing the oldest voice if they're
+// all busy. Both cases are O(1) (see voices.hpp). Returns the voice that was started.
+// startFrame skips into the sample, e.g. to make up for how long the hit took to detect.
+// Returns -1, starting nothing, if the sample hasn't loaded yet.
+int startPlayingSample(int sensor, float piezoValue, int startFrame) {
+	
+	if (!gSampleReady[sensor].load(std::memory_order_acquire)) {
+		EVENT_SAMPLE_NOT_READY(sensor);
+		return -1;
+	}
 	
+	int stole;
+	int voice = gVoices.allocate(&stole);
+	// gVoices.start(voice, sensor, piezoValue * sampleScalers[sensor], gSampleCount);
+	gVoices.start(voice, sensor, piezoValue, gSampleCount);
 	
-	// See if we have a free pointer.
-	for (int i = 0; i < NUM_VOICES; i++) {
-		if (gPointerState[i] == 0) {
-			gReadPointerBufferID[i] = sensor;
-			gPointerState[i] = 1;
-			gReadPointerAge[i] = gSampleCount;
-			// gSampleVelocity[i] = piezoValue * sampleScalers[sensor];
-			gSampleVelocity[i] = piezoValue;
-			gReadPointers[i] = 0; // Set read to the beginning of the sample
-			rt_printf("Found a loose voice! It was index %d\n", i);
-
-			return 1; // Return 1 
-		}
+	float rate = 1;
+	if (playAtSourceRate && gSampleData[sensor].sampleRate > 0) {
+		rate = gSampleData[sensor].sampleRate / gPlaybackSampleRate;
 	}
-	int oldest = gReadPointerAge[0];
-	int oldestPointerIndex = 0;
-	for (int j = 0; j < NUM_VOICES; j++) {
-		if (gReadPointerAge[j] < oldest) {
-			oldest = gReadPointerAge[j];
-			oldestPointerIndex = j;
-		}
+	float semitones = sampleTuning[sensor] + velocityToPitch * piezoValue;
+	if (semitones != 0) {
+		rate *= powf(2.0f, semitones / 12.0f);
 	}
-	gPointerState[oldestPointerIndex] = 0;
-	rt_printf("Stole a voice!\n");
+	gVoices.rate[voice] = rate;
+	
+	// startFrame is in frames of output, so skip as far into the sample as the voice would have got.
+	double skip = startFrame * (double)rate;
+	if (skip > 0 && skip < gSampleData[sensor].sampleLen) {
+		gVoices.readPointer[voice] = (int)skip;
+		gVoices.phase[voice] = skip - (int)skip;
+	}
+	if (useStreaming) {
+		streamStart(voice, sensor, gVoices.readPointer[voice]);
+	}
+	
+	EVENT_VOICE(sensor, voice, stole);
 
-	return 0;
+	return voice;
 }
@@ -0,0 +1,187 @@
+/***** profiler.hpp *****/
+/*
+	Cycle counts for each stage of render(), to see how close we are to the block deadline.
+	"mix" covers rendering and advancing the voices (see mixer.hpp), "output" the crackle and audioWrite().
+
+	Define ENABLE_PROFILER in defs.hpp to switch it on; otherwise all the PROFILER_ macros are empty.
+	The audio thread only adds to fixed-size histograms (no allocation, no printing).
+	Once a second the histograms are swapped with a spare set and an auxiliary task
+	prints the mean, 99th percentile and max cost of every stage per block.
+
+	On the board this reads the Cortex-A8 cycle counter, which needs user access to the
+	PMU switched on (PMUSERENR). If it isn't, define PROFILER_USE_CLOCK to time with the
+	monotonic clock (in ns) instead.
+*/
+
+#ifdef ENABLE_PROFILER
+
+#include <atomic>
+#include <cstring>
+#include <time.h>
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(PROFILER_USE_CLOCK)
+#include <x86intrin.h>
+#endif
+
+#ifndef PROFILER_CPU_HZ
+#define PROFILER_CPU_HZ 1000000000.0	// BeagleBone Black, for the headroom figure
+#endif
+#define PROFILER_NUM_BINS 240			// 8 bins per power of two, up to 2^32
+#define PROFILER_REPORT_SECONDS 1
+
+enum {
+	kStageAccelerometer = 0,
+	kStagePiezos,
+	kStageSensors,
+	kStageMix,
+	kStageOutput,
+	kStageTotal,
+	kNumProfilerStages
+};
+
+const char *gProfilerStageNames[kNumProfilerStages] = {
+	"accelerometer", "piezos", "sensors", "mix", "output", "total"
+};
+
+struct ProfilerStats {
+	uint32_t histogram[kNumProfilerStages][PROFILER_NUM_BINS];
+	uint32_t max[kNumProfilerStages];
+	uint64_t sum[kNumProfilerStages];
+	uint32_t numBlocks;
+};
+
+// Two sets: the audio thread fills one while the report task reads the other.
+ProfilerStats gProfilerStats[2];
+int gProfilerActive = 0;
+std::atomic<bool> gProfilerReportBusy(false);
+
+uint32_t gProfilerBlockCycles[kNumProfilerStages];
+uint32_t gProfilerLast;
+uint32_t gProfilerBlockStart;
+int gProfilerBlocksPerReport = 1;
+int gProfilerAudioFrames = 1;
+float gProfilerSampleRate = 44100;
+AuxiliaryTask gProfilerTask;
+
+void printProfilerReport();
+
+static inline uint32_t readCycleCounter() {
+#if defined(PROFILER_USE_CLOCK)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#elif defined(__arm__)
+	uint32_t value;
+	asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(value));
+	return value;
+#elif defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+// Bins are exact below 8, then 8 per power of two (at most 12.5% wide).
+static inline int profilerBin(uint32_t cycles) {
+	if (cycles < 8)
+		return cycles;
+	int e = 31 - __builtin_clz(cycles);
+	return (e - 2) * 8 + ((cycles >> (e - 3)) & 7);
+}
+
+static inline uint32_t profilerBinValue(int bin) {
+	if (bin < 8)
+		return bin;
+	int e = bin / 8 + 2;
+	return (uint32_t)(8 + bin % 8) << (e - 3);
+}
+
+void profilerSetup(BelaContext *context) {
+	memset(gProfilerStats, 0, sizeof(gProfilerStats));
+	gProfilerAudioFrames = context->audioFrames;
+	gProfilerSampleRate = context->audioSampleRate;
+	gProfilerBlocksPerReport = PROFILER_REPORT_SECONDS * context->audioSampleRate / context->audioFrames;
+	gProfilerTask = Bela_createAuxiliaryTask(printProfilerReport, 10, "bela-profiler");
+}
+
+static inline void profilerBlockStart() {
+	memset(gProfilerBlockCycles, 0, sizeof(gProfilerBlockCycles));
+	gProfilerBlockStart = readCycleCounter();
+}
+
+static inline void profilerFrameStart() {
+	gProfilerLast = readCycleCounter();
+}
+
+// Charge the time since the last lap (or frame start) to a stage.
+static inline void profilerLap(int stage) {
+	uint32_t now = readCycleCounter();
+	gProfilerBlockCycles[stage] += now - gProfilerLast;
+	gProfilerLast = now;
+}
+
+static inline void profilerBlockEnd() {
+	gProfilerBlockCycles[kStageTotal] = readCycleCounter() - gProfilerBlockStart;
+
+	ProfilerStats *stats = &gProfilerStats[gProfilerActive];
+	for (int s = 0; s < kNumProfilerStages; s++) {
+		uint32_t cycles = gProfilerBlockCycles[s];
+		stats->histogram[s][profilerBin(cycles)]++;
+		stats->sum[s] += cycles;
+		if (cycles > stats->max[s])
+			stats->max[s] = cycles;
+	}
+	stats->numBlocks++;
+
+	// Hand the full set over if the last report has been printed; otherwise keep adding to it.
+	if (stats->numBlocks >= (uint32_t)gProfilerBlocksPerReport && !gProfilerReportBusy.load(std::memory_order_acquire)) {
+		gProfilerActive = !gProfilerActive;
+		gProfilerReportBusy.store(true, std::memory_order_release);
+		Bela_scheduleAuxiliaryTask(gProfilerTask);
+	}
+}
+
+// Auxiliary task: prints the set the audio thread isn't using, then clears it.
+void printProfilerReport() {
+	ProfilerStats *stats = &gProfilerStats[!gProfilerActive];
+	double budget = PROFILER_CPU_HZ * gProfilerAudioFrames / gProfilerSampleRate;
+
+	rt_printf("---- render() cost per block over %u blocks (cycles) ----\n", stats->numBlocks);
+	rt_printf("%-14s %10s %10s %10s\n", "stage", "mean", "p99", "max");
+	for (int s = 0; s < kNumProfilerStages; s++) {
+		uint32_t target = stats->numBlocks - stats->numBlocks / 100;
+		uint32_t count = 0;
+		int p99 = 0;
+		for (int b = 0; b < PROFILER_NUM_BINS; b++) {
+			count += stats->histogram[s][b];
+			if (count >= target) {
+				p99 = b;
+				break;
+			}
+		}
+		rt_printf("%-14s %10llu %10u %10u\n", gProfilerStageNames[s],
+			(unsigned long long)(stats->numBlocks ? stats->sum[s] / stats->numBlocks : 0),
+			profilerBinValue(p99), stats->max[s]);
+	}
+	rt_printf("worst block used %.1f%% of the deadline\n", 100.0 * stats->max[kStageTotal] / budget);
+
+	memset(stats, 0, sizeof(ProfilerStats));
+	gProfilerReportBusy.store(false, std::memory_order_release);
+}
+
+#define PROFILER_SETUP(context) profilerSetup(context)
+#define PROFILER_BLOCK_START() profilerBlockStart()
+#define PROFILER_FRAME_START() profilerFrameStart()
+#define PROFILER_LAP(stage) profilerLap(stage)
+#define PROFILER_BLOCK_END() profilerBlockEnd()
+
+#else
+
+#define PROFILER_SETUP(context)
+#define PROFILER_BLOCK_START()
+#define PROFILER_FRAME_START()
+#define PROFILER_LAP(stage)
+#define PROFILER_BLOCK_END()
+
+#endif /* ENABLE_PROFILER */
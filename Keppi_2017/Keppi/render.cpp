@@ -30,15 +30,22 @@ The Bela software is distributed under the GNU Lesser General Public License
 #include <iterator>
 #include <vector>
 #include <Scope.h>
-#include <deque>
-#include <array>
 #include <WriteFile.h>
 #include "defs.hpp"		// Definitions that all member files need
+#include "spscQueue.hpp"	// Lock-free queue between threads
+#include "eventLog.hpp"	// Hits, voices and light states, printed off the audio thread
+#include "sampleCache.hpp"	// Pre-converted samples, mmapped at boot
 #include "I2C_MPR121.h"	// Library for cap touch
+#include "capture.hpp"	// Recording the sensors for the offline renderer
 #include "accelerometer.hpp" // Code that takes in and filters accelerometer data and sets lights
 #include "coeffs.hpp"	// Code that calculates filter coefficients
 #include "piezos.hpp"	// Code to handle and filter piezo data§
+#include "voices.hpp"	// The voice pool
 #include "play.hpp" 	// code to play samples
+#include "mixer.hpp"	// Block-based voice mixing
+#include "streaming.hpp"	// Streaming samples from disk
+#include "profiler.hpp"	// Per-stage cycle counts for render()
+#include "latency.hpp"	// Touch-to-sound latency per pad
 
 using namespace std;
 
@@ -53,7 +60,7 @@ int gSampleCount = 0; // Master sample counter, ticks up every time audio update
 // --------------------------------
 // Declare external functions:
 
-void calculateCoeffs();
+void calculateCoeffs(double sampleRate);
 // --------------------------------
 
 // --------------------------------
@@ -95,9 +102,18 @@ int gLightFlashCount = 0;
 These are the variables for sample handling.
 */
 vector<string> gFilenames = {"clay2.wav", "clay1.wav", "clay3.wav", "clay4.wav"};
-int gEndFrame;
-int gStartFrame = 0;
 SampleData gSampleData[NUM_SAMPLES];
+int useInt16Samples = 0; // Set to 1 to keep samples as 16 bit (half the memory) rather than float
+
+// The WAVs load in the background once audio is running, so the pads come up one by one as
+// their samples arrive instead of all at once at the end of setup(). A pad doesn't play until
+// its gSampleReady is set.
+std::atomic<bool> gSampleReady[NUM_SAMPLES];
+std::atomic<bool> gSamplesLoading(false);	// Set while the load task has work to do
+bool gSampleLoadScheduled = false;			// Set once render() has queued the load task
+int sampleLoadWaitMs = 10000;				// How long cleanup() waits for the load task to finish
+AuxiliaryTask gSampleLoadTask;
+void loadSamples();
 
 
 
@@ -110,16 +126,42 @@ int readInterval = 200;		// Change this to change how often the MPR121 is read (
 int threshold = 20;			// Change this threshold to set the minimum amount of touch
 int sensorValue[NUM_TOUCH_PINS];// This array holds the continuous sensor values
 I2C_MPR121 mpr121;			// Object to handle MPR121 sensing
+MPR121Data mpr121Data;		// Everything we read from it on each poll
 AuxiliaryTask i2cTask;		// Auxiliary task to read I2C
 int readCount = 0;			// How long until we read again...
 int readIntervalSamples = 0; // How many samples between reads
 void readMPR121();
 
+// Interrupt mode: instead of polling at readInterval, watch the MPR121's IRQ output (active low,
+// asserted when the touch status changes and cleared when we read it) on a digital input, and
+// read as soon as it goes low. A slow poll keeps running so the baseline data stays fresh.
+int useInterrupt = 0;			// Set to 1 to read on the IRQ line
+int interruptPin = 1;			// Digital input wired to the MPR121 IRQ pin
+int fallbackReadInterval = 10;	// How often to read anyway in interrupt mode (in Hz)
+std::atomic<bool> gMPR121ReadPending(false); // Set while a read is scheduled but hasn't finished
+
 int gPrevTouchState[NUM_TOUCH_PINS] = { 0 };
 int gTouchState[NUM_TOUCH_PINS] = { 0 };
 int gSensorPlayState[NUM_TOUCH_PINS] = { 0 }; // keeps track of which is playing
 
-// Cap touch state machine:
+// Touches and releases found by readMPR121() are passed to the audio thread as events,
+// stamped with the frame the read was scheduled at. render() collects them once per block
+// and handles each one on its own frame (touchEventDelay frames after its stamp, or as soon
+// as possible if that's already gone by). Setting touchEventDelay to at least the worst-case
+// delay of the I2C task makes touch handling land a fixed time after each poll.
+#define TOUCH_QUEUE_SIZE 64
+struct TouchEvent {
+	int electrode;
+	int edge;			// 1: touched, 0: released
+	uint64_t frame;		// audioFramesElapsed when the read was scheduled
+};
+SpscQueue<TouchEvent, TOUCH_QUEUE_SIZE> gTouchEvents;
+TouchEvent gPendingTouches[TOUCH_QUEUE_SIZE]; // Events collected but not yet due
+int gNumPendingTouches = 0;
+int touchEventDelay = 0;
+std::atomic<uint64_t> gMPR121ReadFrame(0); // When the current read was scheduled
+
+// Cap touch state machine (only the audio thread touches this):
 // States: 
 // 0: Waiting for touch.
 // 1: Touched - triggers piezo buffering and return of variable, then goes back to 0.
@@ -129,19 +171,10 @@ int gSensorDebounce[NUM_TOUCH_PINS];
 /* ========
 	VOICE STEALING
    ========
-These variables keep track of:
-- All read pointers, and where they are in their buffers 
-- If they're active (1 for active, 0 for waiting)
-- What samples they are playing (aka buffer ID - a number from 0-3)
-- The velocity the sample is being played at (returned by piezos)
-- How old the pointer is (so we can steal the oldest)
+The read pointers, what they're playing and how old they are live in the
+voice pool, gVoices (see voices.hpp).
 */
-
-int gReadPointers[NUM_VOICES] = { 0 };
-int gPointerState[NUM_VOICES] = { 0 };
-int gReadPointerBufferID[NUM_VOICES] = { 0 };
-float gSampleVelocity[NUM_VOICES] = { 0 };
-int gReadPointerAge[NUM_VOICES] = { 0 };
+int numVoices = DEFAULT_VOICES;	// How many samples can sound at once (1 to MAX_VOICES); --voices sets it (main.cpp)
 
 
 /* ========
@@ -149,22 +182,53 @@ int gReadPointerAge[NUM_VOICES] = { 0 };
    ========
 	Here we have:
 	- Piezo state (are we just buffering, or are we looking for a peak)?
-	- An array of 4 deques used to buffer samples 
+	- A window per sensor used to buffer samples (see piezos.hpp)
 	- The peak value returned over buffered samples
-	- How many samples we have in our deque (should be 100, but we count in case it's less)
-	- The current filtered and cleaned piezo sample (gCurrentSampleDCBlocked)
+	- How many samples we have in our window (should be 100, but we count in case it's less)
+	- The filtered and cleaned piezo samples for this block (gPiezoBlock, see piezos.hpp)
 	- Scalers to correct the velocity value, in case piezos are too sensitive/not sensitive enough
 */
 
 int gPiezoState[NUM_TOUCH_PINS] = { 0 }; //0: wait and buffer; 1: look for peak
 
-std::array< std::deque<float>, NUM_TOUCH_PINS > gPiezoBufferDeques; // make 4 deques for buffering.
+PiezoWindow gPiezoWindows[NUM_TOUCH_PINS]; // make 4 windows for buffering.
 
-float gPiezoPeak[NUM_TOUCH_PINS] = { 0 }; // This is the MAX VALUE in our deque of 300 collected samples.
-int gNumSamplesInDeque[NUM_TOUCH_PINS] = { 0 }; // We count the number of buffered samples in the back buffer - in case we happento gather less than 100.
-extern float gCurrentSampleDCBlocked[NUM_TOUCH_PINS];
+float gPiezoPeak[NUM_TOUCH_PINS] = { 0 }; // This is the MAX VALUE in our window of 300 collected samples.
+int gNumSamplesInWindow[NUM_TOUCH_PINS] = { 0 }; // We count the number of buffered samples in the back buffer - in case we happento gather less than 100.
 float gScalerValues[4] = {4.0, 6.0, 6.0, 4.0};
 
+float *gCrackleBuffer; // The crackle for each frame of the block, as the light state was on that frame
+
+// Hand a loaded sample over to the audio thread.
+void publishSample(int i) {
+	LATENCY_SAMPLE_READY(i);
+	gSampleReady[i].store(true, std::memory_order_release);
+}
+
+// Load sample i into gSampleData. Called from the loader threads, one sample per call; what it
+// has to say goes in log, which loadSamplesInParallel() prints when they're all done.
+bool loadKeppiSample(int i, ostream &log) {
+	// Use the converted copy if it's up to date ...
+	int cacheFormat = useInt16Samples ? SAMPLE_CACHE_FORMAT_INT16 : SAMPLE_CACHE_FORMAT_FLOAT;
+	if (!loadSampleCache(gFilenames.at(i), 0, cacheFormat, &gSampleData[i])) {
+		// ... otherwise decode the WAV, and write one for next time.
+		if (loadSample(gFilenames.at(i), 0, &gSampleData[i], log) != 0)
+			return false;
+		if (useInt16Samples)
+			convertSampleToInt16(&gSampleData[i]);
+		if (!writeSampleCache(gFilenames.at(i), 0, &gSampleData[i]))
+			log << "Couldn't write the sample cache for " << gFilenames.at(i) << endl;
+	}
+	publishSample(i);
+	return true;
+}
+
+// Auxiliary task: load all the samples (side by side, as decoding takes a while).
+void loadSamples() {
+	if (!loadSamplesInParallel(gFilenames, loadKeppiSample))
+		rt_printf("Some samples didn't load; their pads will stay silent\n");
+	gSamplesLoading.store(false, std::memory_order_release);
+}
 
 bool setup(BelaContext *context, void *userData)
 {
@@ -182,24 +246,64 @@ bool setup(BelaContext *context, void *userData)
     
     // Init I2C stuff:
 	i2cTask = Bela_createAuxiliaryTask(readMPR121, 50, "bela-mpr121");	
-	readIntervalSamples = context->audioSampleRate / readInterval;
+	if (useInterrupt) {
+		pinMode(context, 0, interruptPin, INPUT);
+		readIntervalSamples = context->audioSampleRate / fallbackReadInterval;
+	} else {
+		readIntervalSamples = context->audioSampleRate / readInterval;
+	}
 	if(!mpr121.begin(1, 0x5A)) {
 		rt_printf("Error initialising MPR121\n");
 		return false;
 	}
     
+	if (numVoices < 1 || numVoices > MAX_VOICES) {
+		rt_printf("Can't play %d voices (1 to %d)\n", numVoices, MAX_VOICES);
+		return false;
+	}
+	gVoices.clear(numVoices); // Before streaming, which gives each voice a ring
+    
 	// Get the sample data:
-    for (int i = 0; i < NUM_SAMPLES; i++) {
-    	gSampleData[i].sampleLen = getNumFrames(gFilenames.at(i));
-    	gEndFrame = gSampleData[i].sampleLen;
-	    
-	    // gSampleData[i][ch].sampleLen = getNumFrames(gFilenames.at(i));
-	    gSampleData[i].samples = new float[gSampleData[i].sampleLen];
-	    getSamples(gFilenames.at(i),gSampleData[i].samples,0,gStartFrame,gEndFrame);
-    }
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		gSampleReady[i].store(false);
+	}
+	if (useStreaming) {
+		// Just the heads, which don't take long; the rest comes from disk as it plays.
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			if (!openSampleStream(i, gFilenames.at(i)))
+				return false;
+			if (useInt16Samples)
+				convertSampleToInt16(&gSampleData[i]);
+		}
+		if (!setupStreaming())
+			return false;
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			publishSample(i);
+		}
+	} else {
+		// Loaded by loadSamples() once render() is running.
+		gSampleLoadTask = Bela_createAuxiliaryTask(loadSamples, 5, "bela-load");
+		if (gSampleLoadTask == 0)
+			return false;
+		gSamplesLoading.store(true);
+	}
     
+	for (int i = 0; i < NUM_TOUCH_PINS; i++) {
+		gPiezoWindows[i].clear();
+	}
+	gPlaybackSampleRate = context->audioSampleRate;
+	gMixBuffer = new float[context->audioFrames];
+	gCrackleBuffer = new float[context->audioFrames];
+	
 	// Get filter values:
-	calculateCoeffs();
+	setupAccelerometer(SAMPLE_RATE); // At its control rate, SAMPLE_RATE / accelDecimation
+	setupPiezos(context);
+	setupPeakPicking(context->audioSampleRate);
+	
+	PROFILER_SETUP(context);
+	LATENCY_SETUP(context);
+	EVENT_LOG_SETUP(context);
+	CAPTURE_SETUP(context);
 	
 	return true;
 	
@@ -207,21 +311,67 @@ bool setup(BelaContext *context, void *userData)
 
 void render(BelaContext *context, void *userData)
 {
+	PROFILER_BLOCK_START();
+	mixerStartBlock(context->audioFrames);
+	
+	// Start loading the samples on the first block.
+	if (!gSampleLoadScheduled && gSamplesLoading.load(std::memory_order_relaxed)) {
+		Bela_scheduleAuxiliaryTask(gSampleLoadTask);
+		gSampleLoadScheduled = true;
+	}
+	
+	// Record this block's input (and the reads that came back, before their touch events).
+	CAPTURE_BLOCK(context);
+	
+	// Collect this block's touch events.
+	TouchEvent touchEvent;
+	while (gNumPendingTouches < TOUCH_QUEUE_SIZE && gTouchEvents.pop(touchEvent)) {
+		gPendingTouches[gNumPendingTouches++] = touchEvent;
+	}
+	int nextTouch = 0;
+	
+	// Filter the whole block of piezo input up front.
+	PROFILER_FRAME_START();
+	readPiezos(context);
+	PROFILER_LAP(kStagePiezos);
 
     for(unsigned int n = 0; n < context->audioFrames; n++) {
     	// First, count the samples.
     	gSampleCount = context->audioFramesElapsed;
+    	EVENT_LOG_FRAME(context->audioFramesElapsed + n);
     
-		// Schedule the cap touch via MPR121:
+		// Schedule the cap touch via MPR121: when it's time to poll, or straight away if
+		// the IRQ line says something changed.
+		bool readNow = false;
     	if(++readCount >= readIntervalSamples) {
 			readCount = 0;
+			readNow = true;
+		}
+		if (useInterrupt && digitalRead(context, n, interruptPin) == LOW) {
+			readNow = true;
+		}
+		if (readNow && !gMPR121ReadPending.load(std::memory_order_acquire)) {
+			readCount = 0;
+			gMPR121ReadPending.store(true, std::memory_order_relaxed);
+			gMPR121ReadFrame.store(context->audioFramesElapsed + n, std::memory_order_relaxed);
 			Bela_scheduleAuxiliaryTask(i2cTask);
 		}
 		
-		// If we're on even numbered samples, read the accel and piezos.
+		// Handle the touch events that are due on this frame.
+		while (nextTouch < gNumPendingTouches && gPendingTouches[nextTouch].frame + touchEventDelay <= context->audioFramesElapsed + n) {
+			if (gPendingTouches[nextTouch].edge == 1) {
+				gSensorState[gPendingTouches[nextTouch].electrode] = 1; // Set state to triggering
+				LATENCY_TOUCH(gPendingTouches[nextTouch].electrode, gPendingTouches[nextTouch].frame, context->audioFramesElapsed + n);
+			}
+			nextTouch++;
+		}
+		
+		PROFILER_FRAME_START();
+		
+		// If we're on even numbered samples, read the accel.
 		if(!(n % 2)) {
 			readAccelerometer(context, n);
-			readPiezos(context, n);
+			PROFILER_LAP(kStageAccelerometer);
 		}
 		
 		// TO DO:
@@ -231,12 +381,15 @@ void render(BelaContext *context, void *userData)
 		
 		// CHECK SENSORS:
        	for (int s = 0; s < NUM_TOUCH_PINS; s++) { 
+       		float piezo = gPiezoBlock[s][n / 2]; // Analog inputs run at half the audio rate
        		
 	       	if (gSensorState[s] == 0) { // If we're not touched ..
 	       		gPiezoState[s] = 0; // Keep the piezo buffering.
 	       	
 	       	} else if (gSensorState[s] == 1) { // If we're touched ...
-	       		gNumSamplesInDeque[s] = gPiezoBufferDeques[s].size(); // Check how many samples we have in the buffer
+	       		// Check how many samples we have in the buffer. If we're touched again while collecting,
+	       		// don't wait for more than the window can hold.
+	       		gNumSamplesInWindow[s] = min(gPiezoWindows[s].size(), PIEZO_WINDOW_SIZE - NUM_PIEZO_VALUES_FRONT);
 	       		gPiezoState[s] = 1; // Move to piezo collecting state
 	       		// gSensorDebounce[s] = 0; // Get ready to count debounce samples
 	       		gSensorState[s] = 2; // Move to debounce state
@@ -254,20 +407,30 @@ void render(BelaContext *context, void *userData)
        		// 0: Buffer away
        		// 1: Triggered - find highest value and return
 	       	if (gPiezoState[s] == 0) {
-				// If we're just buffering, store the value in our deque.
-				gPiezoBufferDeques[s].push_back(gCurrentSampleDCBlocked[s]);
-				//  If the deque has more than 100 items in it, pop the value off the front - it's too old, we don't need it.
-				if (gPiezoBufferDeques[s].size() >= NUM_PIEZO_VALUES_BACK) {
-					gPiezoBufferDeques[s].pop_front();
+				// If we're just buffering, store the value in our window.
+				gPiezoWindows[s].push(piezo);
+				trackPeakEnvelope(s, piezo);
+				//  If the window has more than 100 items in it, pop the value off the front - it's too old, we don't need it.
+				if (gPiezoWindows[s].size() >= NUM_PIEZO_VALUES_BACK) {
+					gPiezoWindows[s].popFront();
 				}
 
 			} else if (gPiezoState[s] == 1) {
-				gPiezoBufferDeques[s].push_back(gCurrentSampleDCBlocked[s]);
+				gPiezoWindows[s].push(piezo);
+				trackPeakEnvelope(s, piezo);
 				
-				// If we have collected enough forward samples:
-				if (gPiezoBufferDeques[s].size() >= NUM_PIEZO_VALUES_FRONT + gNumSamplesInDeque[s]) {
-					// Save the peak value:
-					gPiezoPeak[s] = *max_element(gPiezoBufferDeques[s].begin(), gPiezoBufferDeques[s].end());
+				// If we have collected enough forward samples (or, peak picking, the hit has peaked):
+				int framesSinceTouch = gPiezoWindows[s].size() - gNumSamplesInWindow[s];
+				bool windowDone;
+				if (usePeakPicking) {
+					windowDone = peakPicked(s, gPiezoWindows[s], framesSinceTouch);
+				} else {
+					windowDone = framesSinceTouch >= NUM_PIEZO_VALUES_FRONT;
+				}
+				if (windowDone) {
+					LATENCY_WINDOW(s, context->audioFramesElapsed + n);
+					// Save the peak value (the window keeps track of it as samples come in):
+					gPiezoPeak[s] = gPiezoWindows[s].max();
 					// Map the peak to pass it to the play function:
 					gPiezoPeak[s] *= gScalerValues[s];
 					float sampleVelocity = map(gPiezoPeak[s], 0.001, 0.2, 0.01, 1.6);
@@ -280,86 +443,31 @@ void render(BelaContext *context, void *userData)
 					// sampleVelocity *= gScalerValues[s];
 					// Pass value to play function. 
 					
-					// Evaluate if our play function returns 0. If it doesn't, it's started to play.
-					// If it does, we just freed up a voice so we can run it again.
+					// Start playing. If all the voices are busy, this steals the oldest.
+					// Peak picking can start the sample as far in as the peak is old.
+                    int startFrame = 0;
+                    if (usePeakPicking && peakCompensateOffset) {
+                    	startFrame = gPiezoWindows[s].maxAge();
+                    }
+                    int voice = -1;
                     if (!gIsAudioMuted) {
-                    	if (startPlayingSample(s, sampleVelocity) == 0) { 
-                        	startPlayingSample(s, sampleVelocity); 
-                        }
+                    	// Mix the voices that are already sounding up to this frame first,
+                    	// so the new one (or the one it steals) starts and stops right here.
+                    	mixVoicesUpTo(n);
+                    	voice = startPlayingSample(s, sampleVelocity, startFrame);
                     }
-					// Clear the deque so we're ready to start buffering again:
-					gPiezoBufferDeques[s].clear();
+                    LATENCY_VOICE(s, s, startFrame, voice >= 0, context->audioFramesElapsed + n);
+					// Clear the window so we're ready to start buffering again:
+					gPiezoWindows[s].clear();
 				
-					rt_printf("The highest piezo value was %f!\n", gPiezoPeak[s]);
-					rt_printf("the velocity was %f\n", sampleVelocity);
+					EVENT_HIT(s, gPiezoPeak[s], sampleVelocity);
 					gPiezoState[s] = 0;
 					}
 				}
 	       	} // Finished checking all the sensors for their states.
+		PROFILER_LAP(kStageSensors);
        	
        
-		// Start an output variable.
-	    float out = 0;
-		float sampleOutputs[NUM_TOUCH_PINS] = { 0 };
-	 	float sampleScalers[NUM_TOUCH_PINS] = { 0 };
-	 	float numberOfSamples[NUM_TOUCH_PINS] = { 1, 1, 1, 1 }; 
-	 	// Count up number of samples on each sensor
-	 	for (int j = 0; j < NUM_VOICES; j++) {
-	 		if (gPointerState[j] == 1) {
-	 			switch (gReadPointerBufferID[j]) {
-	 				case 0: {
-	 					numberOfSamples[0] += 1;
-	 					sampleOutputs[0] += gSampleData[gReadPointerBufferID[j]].samples[gReadPointers[j]] * gSampleVelocity[j];
-	 					break;
-	 				}
-	 				case 1: {
-	 					numberOfSamples[1] += 1;
-	 					sampleOutputs[1] += gSampleData[gReadPointerBufferID[j]].samples[gReadPointers[j]] * gSampleVelocity[j];
-						break;
-	 				}
-	 				case 2: {
-	 					numberOfSamples[2] += 1;
-	 					sampleOutputs[2] += gSampleData[gReadPointerBufferID[j]].samples[gReadPointers[j]] * gSampleVelocity[j];
-	 					break;
-	 				}
-	 				case 3: {
-	 					numberOfSamples[3] += 1;
-	 					sampleOutputs[3] += gSampleData[gReadPointerBufferID[j]].samples[gReadPointers[j]] * gSampleVelocity[j];
-	 					break;
-	 				}
-	 				default: {
-	 					break;
-	 				}
-	 			} // end switch
-	 		} // end if
-	 	} // end for
-	 	// int numSensorsActive = 1;
-	 	
-	 	// calculate each sample's scaler
-	 	// for (int i = 0; i < NUM_TOUCH_PINS; i++) {
-	 	// 	if (numberOfSamples[i] != 1) {
-	 	// 		numSensorsActive++;
-	 	// 	}
-	 	// }
-	 	
-	 	
-	 	for (int i = 0; i < NUM_TOUCH_PINS; i++) {
-	 		// sampleScalers[i] = 1/numberOfSamples[i];
-	 		// sampleOutputs[i] *= sampleScalers[i];
-	 		out += sampleOutputs[i] * 1.2;
-	 	}
-	 	
-	 	// float masterScaler = 1 / float(numSensorsActive);
-	 	// out *= masterScaler;
-	    
-	    // for (int i = 0; i < NUM_VOICES; i++) {
-	    // 	if(gReadPointers[i] >= 0 && gPointerState[i] == 1) {
-	    // 		float outputSample = gSampleData[gReadPointerBufferID[i]].samples[gReadPointers[i]] * gSampleVelocity[i];
-	    // 		out += outputSample;
-	    // 		// out *= outputScaler;
-	    // 	}
-	    // }
-
 	   // Crackle of 0 has no effect. Crackle of 1 is silent. Crackle of 0.2 is crackle.
 	    float crackle = 0;
 	    if (gLightState == 0) { 
@@ -369,6 +477,33 @@ void render(BelaContext *context, void *userData)
 	    } else {
 	    	crackle = 0; 				// Otherwise, don't bother with crackle
 	    }
+	    gCrackleBuffer[n] = crackle;
+	    
+	    // Writing the piezo data for Jack:
+	    
+	    
+	    // audioWrite(context, n, 0, gPiezoBlock[3][n / 2]);
+	    // audioWrite(context, n, 1, gPiezoBlock[3][n / 2]);
+	    
+	    //scope.log();
+    	
+    }// end sensor loop
+    
+    // Keep any touch events that aren't due yet for the next block.
+    for (int i = nextTouch; i < gNumPendingTouches; i++) {
+    	gPendingTouches[i - nextTouch] = gPendingTouches[i];
+    }
+    gNumPendingTouches -= nextTouch;
+    
+    // Mix the rest of the block. This also advances the read pointers, and stops any
+    // voice that gets to the end of its sample.
+    PROFILER_FRAME_START();
+    mixVoicesUpTo(context->audioFrames);
+    PROFILER_LAP(kStageMix);
+    
+    for(unsigned int n = 0; n < context->audioFrames; n++) {
+	    float out = gMixBuffer[n];
+	    float crackle = gCrackleBuffer[n];
 	    
 	    if (out > 0) {
 			out -= crackle;
@@ -388,39 +523,31 @@ void render(BelaContext *context, void *userData)
 	    for(unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
 			audioWrite(context, n, channel, out);
 	    }
-	    
-	    
-	    // ADVANCE READ POINTERS. If they're at the end of the sample, make them inactive and reset.
-		for(int j=0; j < NUM_VOICES; j++) {
-		
-			if (gPointerState[j] == 1 && gReadPointers[j] < gSampleData[gReadPointerBufferID[j]].sampleLen) {
-    			gReadPointers[j]++;
-			} else {
-    			gPointerState[j] = 0;
-    			gReadPointers[j] = 0;
-			}
-		}
-	    
-	    // Writing the piezo data for Jack:
-	    
-	    
-	    // audioWrite(context, n, 0, gCurrentSampleDCBlocked[3]);
-	    // audioWrite(context, n, 1, gCurrentSampleDCBlocked[3]);
-	    
-	    //scope.log();
-    	
     }// end audio loop
+    PROFILER_LAP(kStageOutput);
+    
+    PROFILER_BLOCK_END();
+    LATENCY_BLOCK_END(context->audioFramesElapsed + context->audioFrames);
+    EVENT_LOG_BLOCK_END();
 } // end render
 
 
 void readMPR121()
 {
+	uint64_t readFrame = gMPR121ReadFrame.load(std::memory_order_relaxed);
 #ifdef DEBUG_MPR121
 	static int printCounter = 20;
 #endif
 	
+	// One bus transaction gets the touch bits, filtered data and baselines together.
+	// Reading the touch status also releases the IRQ line.
+	bool readOk = mpr121.readAll(&mpr121Data);
+	gMPR121ReadPending.store(false, std::memory_order_release);
+	if(!readOk)
+		return;
+	
 	for(int i = 0; i < NUM_SAMPLES; i++) {
-		sensorValue[i] = -(mpr121.filteredData(i) - mpr121.baselineData(i));
+		sensorValue[i] = -(mpr121Data.filtered[i] - mpr121Data.baseline[i]);
 		sensorValue[i] -= threshold;
 		if(sensorValue[i] < 0)
 			sensorValue[i] = 0;
@@ -431,7 +558,7 @@ void readMPR121()
 		if(i == 0)
 			printCounter--;
 		if(printCounter == 0)
-			rt_printf("%d/%d ", mpr121.filteredData(i), mpr121.baselineData(i));
+			rt_printf("%d/%d ", mpr121Data.filtered[i], mpr121Data.baseline[i]);
 #endif
 	}
 #ifdef DEBUG_MPR121
@@ -442,30 +569,38 @@ void readMPR121()
 #endif
 	
 	// You can use this to read binary on/off touch state more easily
-	//rt_printf("Touched: %x\n", mpr121.touched());
+	//rt_printf("Touched: %x\n", mpr121Data.touched);
 	
 	// Do multitouch.
 	// 1. Save the current touch state as previous touch state.
 	// 2. Then, determine if the sensor is currently touched.
     for (int i = 0; i < NUM_SAMPLES; i++) {
     	gPrevTouchState[i] = gTouchState[i];
-		if (mpr121.touched() & (1 << i))  {
+		if (mpr121Data.touched & (1 << i))  {
 			//if(gTouchState[i] == 0)
 			//	rt_printf("%d is pressed\n", i);
 		    gTouchState[i] = 1;
 		} else {
 			gTouchState[i] = 0;
 		}
+    	if (gPrevTouchState[i] != gTouchState[i]) {
+    		// Pass the touch or release to the audio thread. If the queue is full, forget we
+    		// saw it, so the next read finds the same change and tries again.
+    		TouchEvent event = { i, gTouchState[i], readFrame };
+    		if (!gTouchEvents.push(event)) {
+    			gTouchState[i] = gPrevTouchState[i];
+    		}
+    	}
     	if (!gPrevTouchState[i] && gTouchState[i]) {
    			rt_printf("Electrode %d is triggered!\n", i);
-   			
-   			gSensorState[i] = 1; // Set state to triggering 
    		}
    		if (gPrevTouchState[i] && !gTouchState[i]) {
    			//rt_printf("Electrode %d has been released!\n", i);
    			
    		}
    	}
+   	// After the touch events, so the audio thread never sees the read before them.
+   	CAPTURE_MPR121(readFrame, mpr121Data);
 }
 
 // void checkButton(BelaContext *context, int frame, int buttonPin) {
@@ -490,11 +625,28 @@ void readMPR121()
 
 void cleanup(BelaContext *context, void *userData)
 {
-	for (int i = 0; i < NUM_SAMPLES; i++) {
-	    
-	    	delete[] gSampleData[i].samples;
-	 
+	// Let the load task finish with the samples before freeing them. If render() never
+	// queued it there's nothing to wait for; if it doesn't finish in time (or never got to
+	// run), leave the samples allocated rather than free them under it.
+	for (int waited = 0; gSampleLoadScheduled && waited < sampleLoadWaitMs; waited++) {
+		if (!gSamplesLoading.load(std::memory_order_acquire))
+			break;
+		usleep(1000);
+	}
+	if (gSampleLoadScheduled && gSamplesLoading.load(std::memory_order_acquire)) {
+		rt_printf("The sample load task didn't finish; not freeing the samples\n");
+	} else {
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			freeSampleData(&gSampleData[i]);
+		}
 	}
+	delete[] gMixBuffer;
+	delete[] gCrackleBuffer;
+	cleanupPiezos();
+	if (useStreaming)
+		cleanupStreaming();
+	EVENT_LOG_CLEANUP();
+	CAPTURE_CLEANUP();
 }
 
 
@@ -0,0 +1,184 @@
+/***** sampleCache.hpp *****/
+/*
+	Pre-converted sample cache, so booting doesn't have to decode the WAVs.
+
+	Next to every sample, e.g. clay1.wav, we keep clay1.wav.cache: a 64-byte header and then
+	the channel we play as raw floats or 16-bit integers (however we're storing samples),
+	ready to use. On boot the cache is mmapped and the samples point straight into it, so
+	loading costs a few system calls however big the kit.
+	If the cache is missing, from another version, or doesn't match the WAV's size and
+	modification time any more, the WAV is decoded as before and the cache (re)written.
+	host/keppi_cache.cpp writes them ahead of time.
+
+	Mapped pages are populated up front (Bela also locks all memory with mlockall()), so the
+	audio thread never page-faults on a sample.
+*/
+
+#ifndef SAMPLECACHE_HPP_
+#define SAMPLECACHE_HPP_
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <iostream>
+#include "SampleData.h"
+
+#define SAMPLE_CACHE_MAGIC 0x4B505343	// "KPSC"
+#define SAMPLE_CACHE_VERSION 1
+#define SAMPLE_CACHE_FORMAT_FLOAT 0
+#define SAMPLE_CACHE_FORMAT_INT16 1
+#define SAMPLE_CACHE_DATA_OFFSET 64		// Keeps the data cache-line (and SIMD) aligned
+#define SAMPLE_CACHE_SUFFIX ".cache"
+
+struct SampleCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;			// SAMPLE_CACHE_FORMAT_
+	uint32_t channel;			// Channel of the source it holds
+	uint32_t frames;
+	uint32_t sampleRate;		// Of the source
+	uint64_t sourceSize;		// Size and modification time of the source when converted
+	int64_t sourceMtimeSec;
+	int64_t sourceMtimeNsec;
+	uint32_t dataOffset;
+	uint8_t reserved[SAMPLE_CACHE_DATA_OFFSET - 52];
+};
+
+static_assert(sizeof(SampleCacheHeader) == SAMPLE_CACHE_DATA_OFFSET, "SampleCacheHeader must fill the space before the data");
+
+static inline std::string sampleCachePath(std::string file) {
+	return file + SAMPLE_CACHE_SUFFIX;
+}
+
+static inline size_t sampleCacheFrameSize(uint32_t format) {
+	return format == SAMPLE_CACHE_FORMAT_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// Map the cache for file into sample. Returns false (leaving sample alone) if there's no
+// cache in the given format that matches the file as it is now.
+bool loadSampleCache(std::string file, int channel, int format, SampleData *sample) {
+	struct stat source;
+	if (stat(file.c_str(), &source) != 0)
+		return false;
+	std::string cachePath = sampleCachePath(file);
+	int fd = open(cachePath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat cache;
+	SampleCacheHeader header;
+	bool valid = fstat(fd, &cache) == 0
+		&& (size_t)cache.st_size >= sizeof(header)
+		&& pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+		&& header.magic == SAMPLE_CACHE_MAGIC
+		&& header.version == SAMPLE_CACHE_VERSION
+		&& header.format == (uint32_t)format
+		&& header.channel == (uint32_t)channel
+		&& header.dataOffset == SAMPLE_CACHE_DATA_OFFSET
+		&& header.sourceSize == (uint64_t)source.st_size
+		&& header.sourceMtimeSec == (int64_t)source.st_mtim.tv_sec
+		&& header.sourceMtimeNsec == (int64_t)source.st_mtim.tv_nsec
+		&& (uint64_t)cache.st_size == header.dataOffset + (uint64_t)header.frames * sampleCacheFrameSize(header.format)
+		&& header.frames > 0;
+	if (!valid) {
+		close(fd);
+		return false;
+	}
+
+	size_t length = cache.st_size;
+	void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);	// The mapping keeps the file
+	if (map == MAP_FAILED)
+		return false;
+
+	if (format == SAMPLE_CACHE_FORMAT_INT16) {
+		sample->samples = NULL;
+		sample->samples16 = (int16_t *)((char *)map + header.dataOffset);
+	} else {
+		sample->samples = (float *)((char *)map + header.dataOffset);
+		sample->samples16 = NULL;
+	}
+	sample->sampleLen = header.frames;
+	sample->residentLen = header.frames;
+	sample->sampleRate = header.sampleRate;
+	sample->mapped = map;
+	sample->mappedLen = length;
+	return true;
+}
+
+// Write the cache for file from a loaded sample, in the format it's stored in. It's written
+// to a temporary file and renamed into place, so a half-written cache is never picked up.
+bool writeSampleCache(std::string file, int channel, const SampleData *sample) {
+	struct stat source;
+	if (stat(file.c_str(), &source) != 0)
+		return false;
+
+	SampleCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SAMPLE_CACHE_MAGIC;
+	header.version = SAMPLE_CACHE_VERSION;
+	header.format = sample->samples16 ? SAMPLE_CACHE_FORMAT_INT16 : SAMPLE_CACHE_FORMAT_FLOAT;
+	header.channel = channel;
+	header.frames = sample->sampleLen;
+	header.sampleRate = sample->sampleRate;
+	header.sourceSize = source.st_size;
+	header.sourceMtimeSec = source.st_mtim.tv_sec;
+	header.sourceMtimeNsec = source.st_mtim.tv_nsec;
+	header.dataOffset = SAMPLE_CACHE_DATA_OFFSET;
+
+	std::string cachePath = sampleCachePath(file);
+	std::string tempPath = cachePath + ".tmp";
+	FILE *f = fopen(tempPath.c_str(), "wb");
+	if (!f)
+		return false;
+	const void *data = sample->samples16 ? (const void *)sample->samples16 : (const void *)sample->samples;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(data, sampleCacheFrameSize(header.format), sample->sampleLen, f) == (size_t)sample->sampleLen;
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		unlink(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Switch a loaded sample (not a mapped one) to 16-bit storage. Float samples outside
+// [-1, 1) are clipped.
+void convertSampleToInt16(SampleData *sample) {
+	if (!sample->samples || sample->mapped)
+		return;
+	int16_t *samples16 = new int16_t[sample->residentLen];
+	for (int n = 0; n < sample->residentLen; n++) {
+		float value = sample->samples[n] * 32768.0f;
+		if (value > 32767.0f)
+			value = 32767.0f;
+		else if (value < -32768.0f)
+			value = -32768.0f;
+		samples16[n] = (int16_t)lrintf(value);
+	}
+	delete[] sample->samples;
+	sample->samples = NULL;
+	sample->samples16 = samples16;
+}
+
+// Free a sample however it was loaded.
+void freeSampleData(SampleData *sample) {
+	if (sample->mapped) {
+		munmap(sample->mapped, sample->mappedLen);
+	} else {
+		delete[] sample->samples;
+		delete[] sample->samples16;
+	}
+	sample->samples = NULL;
+	sample->samples16 = NULL;
+	sample->mapped = NULL;
+	sample->mappedLen = 0;
+}
+
+#endif /* SAMPLECACHE_HPP_ */
@@ -0,0 +1,52 @@
+/***** spscQueue.hpp *****/
+/*
+	A fixed-size, wait-free queue for passing records from exactly one thread to exactly one other
+	(e.g. from an auxiliary task to the audio thread). No locks and no allocation: push() and pop()
+	each touch one slot and one atomic counter, and fail rather than wait when full or empty.
+	Size must be a power of two.
+*/
+
+#ifndef SPSCQUEUE_HPP_
+#define SPSCQUEUE_HPP_
+
+#include <atomic>
+
+template <typename T, unsigned int Size>
+class SpscQueue {
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Producer side. Returns false (and drops the item) if the queue is full.
+	bool push(const T& item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Size)
+			return false;
+		items[t & (Size - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if there's nothing to read.
+	bool pop(T& item) {
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h & (Size - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	unsigned int size() {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+private:
+	static_assert((Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+	T items[Size];
+	// On separate cache lines, so the two threads don't fight over them.
+	alignas(64) std::atomic<unsigned int> head;
+	alignas(64) std::atomic<unsigned int> tail;
+};
+
+#endif /* SPSCQUEUE_HPP_ */
@@ -0,0 +1,307 @@
+/***** streaming.hpp *****/
+/*
+	Disk streaming for sample sets too big to keep in memory.
+
+	With useStreaming set, setup() only loads the head of each sample (STREAM_HEAD_FRAMES,
+	SampleData::residentLen) and keeps the file open. Every voice gets a ring buffer, and a
+	non-realtime auxiliary task reads the rest of its sample from disk into the ring, ahead
+	of the read pointer. A voice plays its head straight away, which gives the loader the
+	length of the head to catch up. Memory is NUM_SAMPLES heads plus a ring per voice in use,
+	however long the samples are.
+
+	The audio thread and the loader share one atomic word per voice: the voice's generation
+	(bumped every time it starts), its sample and how far into the sample its ring is filled.
+	The loader only moves the fill point with a compare-and-swap on the whole word, so
+	anything it read for a voice that has since been restarted is thrown away.
+
+	Float and double files are scaled as SampleLoader.h scales them when they're loaded whole
+	(sampleFileScale()), the head and the ring alike.
+
+	cleanupStreaming() raises gStreamStopping and waits for a pass of the loader that is under way to
+	finish; a pass that starts after that sees the flag and leaves everything alone.
+
+	If the loader falls behind, the missing frames play as silence and are counted in
+	gStreamUnderrunFrames; the loader reports new underruns as it sees them.
+
+	Voices that don't play at rate 1 (see mixer.hpp) are mixed a frame at a time, as each
+	interpolated frame may need sample frames from both the head and the ring. They keep the
+	frame before their read position in the ring too, for the cubic interpolation.
+*/
+
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+
+#define STREAM_HEAD_FRAMES 16384	// Resident frames per sample (0.37s at 44.1kHz)
+#define STREAM_RING_FRAMES 16384	// Per voice; a power of two
+#define STREAM_RING_MASK (STREAM_RING_FRAMES - 1)
+#define STREAM_REFILL_FRAMES 4096	// Wake the loader when this much of a ring is free
+#define STREAM_CHUNK_FRAMES 4096	// Frames per disk read
+#define STREAM_IDLE 0xFF			// Sample field of a voice that isn't streaming
+
+int useStreaming = 0;		// Set to 1 to stream samples from disk instead of loading them
+
+extern VoicePool gVoices;
+extern SampleData gSampleData[NUM_SAMPLES];
+
+SNDFILE *gStreamFiles[NUM_SAMPLES];
+int gStreamFileChannels[NUM_SAMPLES];
+float gStreamScale[NUM_SAMPLES];		// sampleFileScale() of each file
+float *gStreamRings;					// gVoices.size rings, one after the other
+float *gStreamReadBuffer;				// Loader's buffer for interleaved frames from disk
+
+// Generation (bits 40-63), sample (bits 32-39) and filled-up-to frame (bits 0-31) of each voice.
+std::atomic<uint64_t> gStreamState[MAX_VOICES];
+std::atomic<int> gStreamReadFrame[MAX_VOICES];	// Voice's read pointer, for the loader
+uint32_t gStreamGeneration[MAX_VOICES];
+
+std::atomic<bool> gStreamFillPending(false);
+std::atomic<bool> gStreamFillBusy(false);	// Set while fillStreams() is running
+std::atomic<bool> gStreamStopping(false);	// Set by cleanupStreaming(): the loader mustn't start
+int streamStopWaitMs = 2000;				// How long cleanup waits for the loader
+std::atomic<unsigned int> gStreamUnderrunFrames(0);
+std::atomic<unsigned int> gStreamUnderruns(0);	// Blocks in which a voice ran dry
+unsigned int gStreamUnderrunsReported = 0;
+AuxiliaryTask gStreamTask;
+
+void fillStreams();
+
+static inline uint64_t streamState(uint32_t generation, int sample, int filled) {
+	return ((uint64_t)(generation & 0xFFFFFF) << 40) | ((uint64_t)sample << 32) | (uint32_t)filled;
+}
+
+static inline int streamStateSample(uint64_t state) {
+	return (state >> 32) & 0xFF;
+}
+
+static inline int streamStateFilled(uint64_t state) {
+	return (int)(state & 0xFFFFFFFF);
+}
+
+// Open a sample for streaming: load its head and keep the file open for the loader.
+bool openSampleStream(int sample, string file) {
+	SF_INFO sfinfo;
+	sfinfo.format = 0;
+	if (!(gStreamFiles[sample] = sf_open(file.c_str(), SFM_READ, &sfinfo))) {
+		cout << "Couldn't open file " << file << ": " << sf_strerror(gStreamFiles[sample]) << endl;
+		return false;
+	}
+	gStreamFileChannels[sample] = sfinfo.channels;
+	gStreamScale[sample] = sampleFileScale(gStreamFiles[sample], sfinfo);
+	gSampleData[sample].sampleLen = sfinfo.frames;
+	gSampleData[sample].sampleRate = sfinfo.samplerate;
+	gSampleData[sample].residentLen = sfinfo.frames < STREAM_HEAD_FRAMES ? sfinfo.frames : STREAM_HEAD_FRAMES;
+	gSampleData[sample].samples = new float[gSampleData[sample].residentLen];
+	return readChannel(gStreamFiles[sample], sfinfo, gSampleData[sample].samples, 0, 0,
+		gSampleData[sample].residentLen, gStreamScale[sample]) == 0;
+}
+
+bool setupStreaming() {
+	gStreamRings = new float[(size_t)gVoices.size * STREAM_RING_FRAMES];
+	int maxChannels = 1;
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		if (gStreamFileChannels[i] > maxChannels)
+			maxChannels = gStreamFileChannels[i];
+	}
+	gStreamReadBuffer = new float[STREAM_CHUNK_FRAMES * maxChannels];
+	gStreamStopping.store(false);
+	for (int v = 0; v < gVoices.size; v++) {
+		gStreamGeneration[v] = 0;
+		gStreamState[v].store(streamState(0, STREAM_IDLE, 0));
+		gStreamReadFrame[v].store(0);
+	}
+	gStreamTask = Bela_createAuxiliaryTask(fillStreams, 30, "bela-stream");
+	return gStreamTask != 0;
+}
+
+void cleanupStreaming() {
+	// Seq_cst, as is the loader's busy flag: either it sees this, or we see it running.
+	gStreamStopping.store(true);
+	for (int waited = 0; gStreamFillBusy.load(); waited++) {
+		if (waited >= streamStopWaitMs) {
+			rt_printf("The stream loader didn't stop; leaving its files open\n");
+			return;
+		}
+		usleep(1000);
+	}
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		if (gStreamFiles[i])
+			sf_close(gStreamFiles[i]);
+		gStreamFiles[i] = NULL;
+	}
+	delete[] gStreamRings;
+	delete[] gStreamReadBuffer;
+}
+
+static inline void requestStreamFill() {
+	if (!gStreamFillPending.exchange(true, std::memory_order_acq_rel))
+		Bela_scheduleAuxiliaryTask(gStreamTask);
+}
+
+// Audio thread: a voice has started playing sample from startFrame. Its ring is empty.
+void streamStart(int v, int sample, int startFrame) {
+	gStreamGeneration[v]++;
+	if (gSampleData[sample].residentLen >= gSampleData[sample].sampleLen) {
+		// Short enough to be all head: nothing to stream.
+		gStreamState[v].store(streamState(gStreamGeneration[v], STREAM_IDLE, 0), std::memory_order_release);
+		return;
+	}
+	gStreamReadFrame[v].store(startFrame, std::memory_order_relaxed);
+	gStreamState[v].store(streamState(gStreamGeneration[v], sample, gSampleData[sample].residentLen), std::memory_order_release);
+	requestStreamFill();
+}
+
+// Audio thread: a voice has stopped, so the loader can leave it alone.
+void streamStop(int v) {
+	gStreamGeneration[v]++;
+	gStreamState[v].store(streamState(gStreamGeneration[v], STREAM_IDLE, 0), std::memory_order_release);
+}
+
+// Audio thread: mix count frames of a voice whose sample streams, from its read pointer on.
+// Frames the loader hasn't got to yet are left out.
+void mixStreamingVoice(int v, SampleData *sample, float *out, float gain, int count) {
+	int readFrame = gVoices.readPointer[v];
+	int endFrame = readFrame + count;
+
+	if (readFrame < sample->residentLen) {
+		int n = sample->residentLen - readFrame < count ? sample->residentLen - readFrame : count;
+		mixSampleBlock(out, sample, readFrame, gain, n);
+		out += n;
+		readFrame += n;
+	}
+
+	int filled = streamStateFilled(gStreamState[v].load(std::memory_order_acquire));
+	int available = filled < endFrame ? filled : endFrame;
+	const float *ring = gStreamRings + v * STREAM_RING_FRAMES;
+	while (readFrame < available) {
+		int offset = readFrame & STREAM_RING_MASK;
+		int n = available - readFrame;
+		if (n > STREAM_RING_FRAMES - offset)
+			n = STREAM_RING_FRAMES - offset;
+		mixVoiceBlock(out, ring + offset, gain, n);
+		out += n;
+		readFrame += n;
+	}
+	if (readFrame < endFrame) {
+		gStreamUnderrunFrames.fetch_add(endFrame - readFrame, std::memory_order_relaxed);
+		gStreamUnderruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	gStreamReadFrame[v].store(endFrame, std::memory_order_release);
+	int ringStart = endFrame > sample->residentLen ? endFrame : sample->residentLen;
+	if (filled < sample->sampleLen && filled - ringStart < STREAM_RING_FRAMES - STREAM_REFILL_FRAMES)
+		requestStreamFill();
+}
+
+// Frame i of a streaming sample, from the head or the ring, or silence if it's outside the
+// sample or not in the ring (frames before ringStart have been overwritten).
+static inline float streamFrame(const SampleData *sample, const float *ring, int ringStart, int filled, int i) {
+	if (i < 0 || i >= sample->sampleLen)
+		return 0;
+	if (i < sample->residentLen)
+		return sample->samples16 ? sample->samples16[i] * SAMPLE_INT16_SCALE : sample->samples[i];
+	if (i >= ringStart && i < filled)
+		return ring[i & STREAM_RING_MASK];
+	return 0;
+}
+
+// Audio thread: mixStreamingVoice() for a voice that isn't playing at rate 1.
+void mixStreamingVoiceResampled(int v, SampleData *sample, float *out, float gain, int count) {
+	int start = gVoices.readPointer[v];
+	float phase = gVoices.phase[v];
+	float rate = gVoices.rate[v];
+	int filled = streamStateFilled(gStreamState[v].load(std::memory_order_acquire));
+	int ringStart = filled - STREAM_RING_FRAMES;
+	const float *ring = gStreamRings + v * STREAM_RING_FRAMES;
+
+	int missing = 0;
+	for (int n = 0; n < count; n++) {
+		double position = phase + (double)n * rate;
+		int i = (int)position;
+		float t = (float)(position - i);
+		i += start;
+		if (i >= filled && i >= sample->residentLen && i < sample->sampleLen)
+			missing++;
+		float y;
+		if (interpolationQuality == kInterpolationCubic) {
+			y = interpolateCubic(streamFrame(sample, ring, ringStart, filled, i - 1), streamFrame(sample, ring, ringStart, filled, i),
+				streamFrame(sample, ring, ringStart, filled, i + 1), streamFrame(sample, ring, ringStart, filled, i + 2), t);
+		} else {
+			y = interpolateLinear(streamFrame(sample, ring, ringStart, filled, i), streamFrame(sample, ring, ringStart, filled, i + 1), t);
+		}
+		out[n] += y * gain;
+	}
+	if (missing) {
+		gStreamUnderrunFrames.fetch_add(missing, std::memory_order_relaxed);
+		gStreamUnderruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Where the next block starts, less the frame before it.
+	int nextFrame = start + (int)(phase + (double)count * rate) - 1;
+	gStreamReadFrame[v].store(nextFrame > 0 ? nextFrame : 0, std::memory_order_release);
+	int nextRingStart = nextFrame > sample->residentLen ? nextFrame : sample->residentLen;
+	if (filled < sample->sampleLen && filled - nextRingStart < STREAM_RING_FRAMES - STREAM_REFILL_FRAMES)
+		requestStreamFill();
+}
+
+// Auxiliary task: top up every streaming voice's ring as far as its read pointer allows.
+void fillStreams() {
+	gStreamFillBusy.store(true);
+	if (gStreamStopping.load()) {
+		gStreamFillBusy.store(false);
+		return;
+	}
+	// Clear this first, so a request made while we're filling gets another pass.
+	gStreamFillPending.store(false, std::memory_order_release);
+
+	for (int v = 0; v < gVoices.size && !gStreamStopping.load(std::memory_order_relaxed); v++) {
+		uint64_t state = gStreamState[v].load(std::memory_order_acquire);
+		int sample = streamStateSample(state);
+		if (sample == STREAM_IDLE)
+			continue;
+		int channels = gStreamFileChannels[sample];
+		int filled = streamStateFilled(state);
+		// The ring holds the frames from the read pointer on (the head doesn't use it).
+		int readFrame = gStreamReadFrame[v].load(std::memory_order_acquire);
+		if (readFrame < gSampleData[sample].residentLen)
+			readFrame = gSampleData[sample].residentLen;
+		int target = readFrame + STREAM_RING_FRAMES;
+		if (target > gSampleData[sample].sampleLen)
+			target = gSampleData[sample].sampleLen;
+		float *ring = gStreamRings + v * STREAM_RING_FRAMES;
+		float scale = gStreamScale[sample];
+
+		while (filled < target) {
+			int offset = filled & STREAM_RING_MASK;
+			int n = target - filled;
+			if (n > STREAM_CHUNK_FRAMES)
+				n = STREAM_CHUNK_FRAMES;
+			if (n > STREAM_RING_FRAMES - offset)
+				n = STREAM_RING_FRAMES - offset;
+
+			sf_seek(gStreamFiles[sample], filled, SEEK_SET);
+			int got = sf_readf_float(gStreamFiles[sample], gStreamReadBuffer, n);
+			if (got < 0)
+				got = 0;
+			for (int i = 0; i < got; i++)
+				ring[offset + i] = gStreamReadBuffer[i * channels] * scale;
+			for (int i = got; i < n; i++)
+				ring[offset + i] = 0;
+
+			// Publish the new frames, unless the voice has been restarted meanwhile.
+			uint64_t newState = (state & ~(uint64_t)0xFFFFFFFF) | (uint32_t)(filled + n);
+			if (!gStreamState[v].compare_exchange_strong(state, newState, std::memory_order_acq_rel))
+				break;
+			state = newState;
+			filled += n;
+		}
+	}
+
+	unsigned int underruns = gStreamUnderruns.load(std::memory_order_relaxed);
+	if (underruns != gStreamUnderrunsReported) {
+		rt_printf("Streaming underrun: %u so far (%u frames of silence)\n", underruns,
+			gStreamUnderrunFrames.load(std::memory_order_relaxed));
+		gStreamUnderrunsReported = underruns;
+	}
+	gStreamFillBusy.store(false);
+}
@@ -0,0 +1,123 @@
+/***** voices.hpp *****/
+/*
+	The voice pool. Each field is its own array (so the mixer walks straight through memory),
+	and the voices that are sounding are kept in a dense list, so mixing and advancing
+	cost O(number sounding) and an idle instrument costs nothing.
+
+	Finding a voice is O(1) too: the idle voices sit on a free list, and the sounding ones
+	are also linked oldest-to-newest, so when we have to steal, the oldest is at the front.
+
+	For each voice we keep:
+	- Its read pointer, and where it is in its buffer
+	- How fast it moves through the buffer (frames of sample per frame of output), and the
+	  fraction of a frame the read pointer is really past where it says
+	- What sample it is playing (aka buffer ID - a number from 0-3)
+	- The velocity the sample is being played at (returned by piezos)
+	- How old it is (so we can steal the oldest)
+
+	The arrays are MAX_VOICES long, so the polyphony can be chosen at startup without
+	allocating anything: clear() puts the first numVoices on the free list and the rest are
+	never used.
+*/
+
+struct VoicePool {
+	int readPointer[MAX_VOICES];
+	float rate[MAX_VOICES];			// 1 plays the sample frame for frame
+	float phase[MAX_VOICES];		// 0 <= phase < 1
+	int bufferID[MAX_VOICES];
+	float velocity[MAX_VOICES];
+	int age[MAX_VOICES];
+	int isActive[MAX_VOICES];		// 1 for active, 0 for waiting
+
+	int active[MAX_VOICES];			// The voices that are sounding ...
+	int activeIndex[MAX_VOICES];	// ... and where each one is in that list
+	int numActive;
+
+	int freeList[MAX_VOICES];		// Stack of idle voices
+	int numFree;
+
+	int older[MAX_VOICES];			// Sounding voices, linked by age (-1 ends the list)
+	int newer[MAX_VOICES];
+	int oldest, newest;
+	int size;						// Voices in use, 1 to MAX_VOICES
+
+	void clear(int voices) {
+		size = voices;
+		for (int v = 0; v < MAX_VOICES; v++) {
+			readPointer[v] = 0;
+			rate[v] = 1;
+			phase[v] = 0;
+			bufferID[v] = 0;
+			velocity[v] = 0;
+			age[v] = 0;
+			isActive[v] = 0;
+			older[v] = newer[v] = -1;
+		}
+		for (int v = 0; v < size; v++)
+			freeList[v] = size - 1 - v; // So voice 0 comes off first
+		numActive = 0;
+		numFree = size;
+		oldest = newest = -1;
+	}
+
+	// Returns an idle voice if there is one, otherwise stops the oldest and returns that.
+	// Sets *stole so the caller can tell which happened.
+	int allocate(int *stole) {
+		if (numFree > 0) {
+			*stole = 0;
+			return freeList[--numFree];
+		}
+		*stole = 1;
+		int v = oldest;
+		stop(v);
+		return freeList[--numFree];
+	}
+
+	// Start an idle voice (one returned by allocate()).
+	void start(int v, int buffer, float vel, int startTime) {
+		bufferID[v] = buffer;
+		velocity[v] = vel;
+		age[v] = startTime;
+		readPointer[v] = 0; // Set read to the beginning of the sample
+		rate[v] = 1;
+		phase[v] = 0;
+		isActive[v] = 1;
+		activeIndex[v] = numActive;
+		active[numActive++] = v;
+
+		// It's the newest voice, so it goes on the end of the age list.
+		older[v] = newest;
+		newer[v] = -1;
+		if (newest >= 0)
+			newer[newest] = v;
+		else
+			oldest = v;
+		newest = v;
+	}
+
+	// Moves the last voice in the list into the gap, so when stopping voices while
+	// walking the list, walk it from the end.
+	void stop(int v) {
+		if (!isActive[v])
+			return;
+		isActive[v] = 0;
+		readPointer[v] = 0;
+		int last = active[--numActive];
+		active[activeIndex[v]] = last;
+		activeIndex[last] = activeIndex[v];
+
+		if (older[v] >= 0)
+			newer[older[v]] = newer[v];
+		else
+			oldest = newer[v];
+		if (newer[v] >= 0)
+			older[newer[v]] = older[v];
+		else
+			newest = older[v];
+		older[v] = newer[v] = -1;
+
+		freeList[numFree++] = v;
+	}
+};
+
+VoicePool gVoices;
@@ -1,5 +1,6 @@
 #include <Bela.h>
 #include <Scope.h>
+#include "filters.hpp"
 
 Scope scope;
 
@@ -8,8 +9,7 @@ double getMaxValue();
 void lights(BelaContext *context, int currentFrame, int peak);
 void assign_state(int peak);
 
-double inputValues[3] = { 0 };
-double outputValues[3] = { 0 };
+DCBlocker<double, 3> gAccelDC;
 double accelDC[3] = { 0 };
 
 float gCurrentPeak = 0;
@@ -30,6 +30,7 @@ int gMostPeak = 0;
 bool setup(BelaContext *context, void *userData)
 {
 	scope.setup(4, context->audioSampleRate);
+	gAccelDC.setup(0.9998);
 	// Set up LED pins:
 	for (int i = 0; i < 6; i++) { // pins 0-5
 		pinMode(context, 0, i, OUTPUT);
@@ -59,12 +60,9 @@ void cleanup(BelaContext *context, void *userData)
 }
 
 void readAccelerometer(BelaContext *context, int currentFrame) {
+	// Analog inputs 0-2, DC blocked together:
+	gAccelDC.process(context->analogIn + (currentFrame/2) * context->analogInChannels, 3, accelDC, 3, 1);
 	for (int i = 0; i < 3; i++) {
-				float accelInput = analogRead(context, currentFrame/2, i);
-				
-				accelDC[i] = accelInput - inputValues[i] + 0.9998 * outputValues[i];
-				inputValues[i] = accelInput;
-				outputValues[i] = accelDC[i];
 				if (accelDC[i] < 0) {
 					accelDC[i] *= -1;
 				}
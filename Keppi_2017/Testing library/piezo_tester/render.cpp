@@ -26,6 +26,7 @@ The Bela software is distributed under the GNU Lesser General Public License
 #include <Scope.h>
 #include <SampleLoader.h>
 #include <SampleData.h>
+#include "filters.hpp"
 
 #define NUM_CHANNELS 1
 
@@ -40,9 +41,7 @@ Scope scope;
 float gPiezoInput; // Piezo sensor input
 
 // DC OFFSET FILTER
-float prevReadingDCOffset = 0;
-float prevPiezoReading = 0;
-float readingDCOffset = 0;
+DCBlocker<float, 1> gPiezoDC;
 float R = 0.99;//1 - (250/44100);
 
 // For onset detection
@@ -72,6 +71,8 @@ bool setup(BelaContext *context, void *userData)
 
 	gReadPtr = -1;
 	
+	gPiezoDC.setup(R);
+	
 	gAudioFramesPerAnalogFrame = context->audioFrames / context->analogFrames;
 
 
@@ -96,10 +97,7 @@ void render(BelaContext *context, void *userData)
 		
 		// Re-centre around 0
 		// DC Offset Filter    y[n] = x[n] - x[n-1] + R * y[n-1]
-		readingDCOffset = gPiezoInput - prevPiezoReading + (R * prevReadingDCOffset);
-		prevPiezoReading = gPiezoInput;
-		prevReadingDCOffset = readingDCOffset;
-		currentSample = readingDCOffset;
+		gPiezoDC.process(&gPiezoInput, 1, &currentSample, 1, 1);
 
 		// Full wave rectify
 	    if(currentSample < 0.0)
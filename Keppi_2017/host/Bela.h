@@ -0,0 +1,116 @@
+/***** Bela.h (host) *****/
+/*
+ * Stand-in for the Bela core API so that a project's render.cpp can be
+ * compiled and run on a plain Linux machine. Only the calls that Keppi and
+ * the testers use are provided. The layout of the buffers (interleaved by
+ * frame, digital words with the direction in the low 16 bits and the value
+ * in the high 16 bits) matches the board, so analogRead() etc. behave the same.
+ */
+
+#ifndef HOST_BELA_H_
+#define HOST_BELA_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "Utilities.h"
+#include "rtdk.h"
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+
+// Digital pin names used by the testers:
+#define P8_07 0
+#define P8_08 1
+#define P8_09 2
+#define P8_10 3
+#define P8_11 4
+#define P8_12 5
+#define P9_12 6
+#define P9_14 7
+
+typedef struct {
+	const float *audioIn;
+	float *audioOut;
+	const float *analogIn;
+	float *analogOut;
+	uint32_t *digital;
+
+	uint32_t audioFrames;
+	uint32_t audioInChannels;
+	uint32_t audioOutChannels;
+	float audioSampleRate;
+
+	uint32_t analogFrames;
+	uint32_t analogInChannels;
+	uint32_t analogOutChannels;
+	float analogSampleRate;
+
+	uint32_t digitalFrames;
+	uint32_t digitalChannels;
+	float digitalSampleRate;
+
+	uint64_t audioFramesElapsed;
+	uint32_t flags;
+} BelaContext;
+
+typedef void *AuxiliaryTask;
+
+extern int volatile gShouldStop;
+
+// User functions, implemented by the project:
+bool setup(BelaContext *context, void *userData);
+void render(BelaContext *context, void *userData);
+void cleanup(BelaContext *context, void *userData);
+
+// Auxiliary tasks. On the host these are run by the offline renderer once the
+// current render() call returns, highest priority first, which keeps every run
+// deterministic.
+AuxiliaryTask Bela_createAuxiliaryTask(void (*callback)(void), int priority, const char *name);
+int Bela_scheduleAuxiliaryTask(AuxiliaryTask task);
+void Bela_runPendingAuxiliaryTasks();
+void Bela_deleteAllAuxiliaryTasks();
+
+static inline float audioRead(BelaContext *context, int frame, int channel) {
+	return context->audioIn[frame * context->audioInChannels + channel];
+}
+
+static inline void audioWrite(BelaContext *context, int frame, int channel, float value) {
+	context->audioOut[frame * context->audioOutChannels + channel] = value;
+}
+
+static inline float analogRead(BelaContext *context, int frame, int channel) {
+	return context->analogIn[frame * context->analogInChannels + channel];
+}
+
+static inline void analogWrite(BelaContext *context, int frame, int channel, float value) {
+	for(unsigned int f = frame; f < context->analogFrames; f++)
+		context->analogOut[f * context->analogOutChannels + channel] = value;
+}
+
+static inline int digitalRead(BelaContext *context, int frame, int channel) {
+	return (context->digital[frame] >> (channel + 16)) & 1;
+}
+
+static inline void digitalWrite(BelaContext *context, int frame, int channel, int value) {
+	for(unsigned int f = frame; f < context->digitalFrames; f++) {
+		if(value)
+			context->digital[f] |= 1 << (channel + 16);
+		else
+			context->digital[f] &= ~(1 << (channel + 16));
+	}
+}
+
+static inline void pinMode(BelaContext *context, int frame, int channel, int mode) {
+	for(unsigned int f = frame; f < context->digitalFrames; f++) {
+		if(mode == INPUT)
+			context->digital[f] |= 1 << channel;
+		else
+			context->digital[f] &= ~(1 << channel);
+	}
+}
+
+#endif /* HOST_BELA_H_ */
@@ -0,0 +1,60 @@
+/***** HostBela.cpp *****/
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <Bela.h>
+
+int volatile gShouldStop = 0;
+int gHostQuiet = 0;
+
+struct HostAuxiliaryTask {
+	void (*callback)(void);
+	int priority;
+	std::string name;
+	bool pending;
+};
+
+static std::vector<HostAuxiliaryTask *> gHostAuxTasks;
+
+AuxiliaryTask Bela_createAuxiliaryTask(void (*callback)(void), int priority, const char *name) {
+	HostAuxiliaryTask *task = new HostAuxiliaryTask;
+	task->callback = callback;
+	task->priority = priority;
+	task->name = name;
+	task->pending = false;
+	gHostAuxTasks.push_back(task);
+	return task;
+}
+
+int Bela_scheduleAuxiliaryTask(AuxiliaryTask task) {
+	if(!task)
+		return -1;
+	((HostAuxiliaryTask *)task)->pending = true;
+	return 0;
+}
+
+static bool higherPriority(const HostAuxiliaryTask *a, const HostAuxiliaryTask *b) {
+	return a->priority > b->priority;
+}
+
+void Bela_runPendingAuxiliaryTasks() {
+	// Run in priority order, as the scheduler on the board would once the
+	// audio thread yields. Tasks scheduled by another task run on the next call.
+	std::vector<HostAuxiliaryTask *> ready;
+	for(unsigned int i = 0; i < gHostAuxTasks.size(); i++) {
+		if(gHostAuxTasks[i]->pending) {
+			gHostAuxTasks[i]->pending = false;
+			ready.push_back(gHostAuxTasks[i]);
+		}
+	}
+	std::stable_sort(ready.begin(), ready.end(), higherPriority);
+	for(unsigned int i = 0; i < ready.size(); i++)
+		ready[i]->callback();
+}
+
+void Bela_deleteAllAuxiliaryTasks() {
+	for(unsigned int i = 0; i < gHostAuxTasks.size(); i++)
+		delete gHostAuxTasks[i];
+	gHostAuxTasks.clear();
+}
@@ -0,0 +1,75 @@
+/***** HostCapture.cpp *****/
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include "HostCapture.h"
+
+using namespace std;
+
+bool loadCapture(const char *path, int analogChannels, CaptureHeader& header,
+	vector<float>& analog, vector<CapturedRead>& reads)
+{
+	FILE *file = fopen(path, "rb");
+	if(!file)
+		return false;
+	vector<uint8_t> bytes;
+	uint8_t buf[65536];
+	size_t got;
+	while((got = fread(buf, 1, sizeof(buf), file)) > 0)
+		bytes.insert(bytes.end(), buf, buf + got);
+	fclose(file);
+
+	if(bytes.size() < sizeof(header))
+		return false;
+	memcpy(&header, &bytes[0], sizeof(header));
+	if(header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION || header.headerSize != sizeof(header)
+		|| header.audioFrames == 0 || header.analogChannels > (unsigned int)analogChannels) {
+		cerr << path << " isn't a capture this version can play" << endl;
+		return false;
+	}
+
+	size_t analogSize = header.analogFrames * header.analogChannels * sizeof(float);
+	size_t blockSize = header.analogFrames * analogChannels;
+	size_t offset = sizeof(header);
+	while(offset + sizeof(CaptureRecordHeader) <= bytes.size()) {
+		CaptureRecordHeader record;
+		memcpy(&record, &bytes[offset], sizeof(record));
+		offset += sizeof(record);
+		if(offset + record.size > bytes.size())
+			break;
+		const uint8_t *data = &bytes[offset];
+		offset += record.size;
+
+		if(record.type == kCaptureAnalog && record.size == analogSize) {
+			size_t start = record.frame / header.audioFrames * blockSize;
+			if(analog.size() < start + blockSize)
+				analog.resize(start + blockSize, 0);
+			for(unsigned int n = 0; n < header.analogFrames; n++)
+				memcpy(&analog[start + n * analogChannels], data + n * header.analogChannels * sizeof(float),
+					header.analogChannels * sizeof(float));
+		} else if(record.type == kCaptureMPR121 && record.size == sizeof(CaptureMPR121)) {
+			CapturedRead read;
+			read.frame = record.frame;
+			memcpy(&read.data, data, sizeof(read.data));
+			reads.push_back(read);
+		} else if(record.type == kCaptureGap && record.size == sizeof(CaptureGap)) {
+			CaptureGap gap;
+			memcpy(&gap, data, sizeof(gap));
+			cerr << "Warning: the capture dropped " << gap.blocks << " blocks (and " << gap.reads
+				<< " MPR121 reads) from frame " << record.frame << "; they play as silence" << endl;
+		}
+	}
+
+	// Here the MPR121 task runs between blocks, so there can be one read per block. On the board
+	// a read can finish mid-block and the IRQ start another in the same block; played back, every
+	// read after that would land a block late, so don't pretend.
+	for(unsigned int i = 1; i < reads.size(); i++) {
+		if(reads[i].frame / header.audioFrames == reads[i - 1].frame / header.audioFrames) {
+			cerr << path << " has two MPR121 reads in the block at frame " << reads[i].frame / header.audioFrames
+				* header.audioFrames << "; it can only be played back with one read per block" << endl;
+			return false;
+		}
+	}
+	return true;
+}
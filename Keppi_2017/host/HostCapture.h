@@ -0,0 +1,26 @@
+/***** HostCapture.h *****/
+/*
+ * Reads the captures Keppi records (Keppi/capture.hpp), for playing them back
+ * through render() on the host (render_offline.cpp, keppi_bench.cpp).
+ */
+
+#ifndef HOST_CAPTURE_H_
+#define HOST_CAPTURE_H_
+
+#include <stdint.h>
+#include <vector>
+#define CAPTURE_FORMAT_ONLY
+#include "capture.hpp"
+
+struct CapturedRead {
+	uint64_t frame;
+	CaptureMPR121 data;
+};
+
+// Load a capture: the analog input into analog (all analogChannels channels, the ones it
+// doesn't have left at zero), the MPR121 reads into reads. Returns false if it can't be read,
+// or if it has more than one read in a block, which the host can't play back.
+bool loadCapture(const char *path, int analogChannels, CaptureHeader& header,
+	std::vector<float>& analog, std::vector<CapturedRead>& reads);
+
+#endif /* HOST_CAPTURE_H_ */
@@ -0,0 +1,122 @@
+/***** HostI2c.cpp *****/
+
+#include "I2c.h"
+#include "HostI2c.h"
+
+#define HOST_I2C_MAX_ADDRESS 128
+#define HOST_I2C_FILE_BASE 1000 // Fake file descriptors start here
+
+static HostI2cDevice *gHostI2cDevices[HOST_I2C_MAX_ADDRESS] = { 0 };
+static HostI2cStats gHostI2cStats[HOST_I2C_MAX_ADDRESS];
+
+void HostI2c_attach(int address, HostI2cDevice *device) {
+	if(address >= 0 && address < HOST_I2C_MAX_ADDRESS)
+		gHostI2cDevices[address] = device;
+}
+
+HostI2cStats HostI2c_getStats(int address) {
+	HostI2cStats stats = HostI2cStats();
+	if(address >= 0 && address < HOST_I2C_MAX_ADDRESS)
+		stats = gHostI2cStats[address];
+	return stats;
+}
+
+void HostI2c_resetStats(int address) {
+	if(address >= 0 && address < HOST_I2C_MAX_ADDRESS)
+		gHostI2cStats[address] = HostI2cStats();
+}
+
+double HostI2c_busTimeUs(const HostI2cStats& stats, double clockHz) {
+	double bits = 9.0 * (stats.messages + stats.bytesWritten + stats.bytesRead)
+		+ stats.messages		// (repeated) start per message
+		+ stats.transactions;	// stop per transaction
+	return 1e6 * bits / clockHz;
+}
+
+static HostI2cDevice *deviceAt(int address) {
+	if(address < 0 || address >= HOST_I2C_MAX_ADDRESS)
+		return NULL;
+	return gHostI2cDevices[address];
+}
+
+int I2c::initI2C_RW(int bus, int address, int file) {
+	i2C_bus = bus;
+	i2C_address = address;
+	if(!deviceAt(address)) {
+		cout << "No host I2C device at address " << address << endl;
+		return 1;
+	}
+	// The fake descriptor encodes the address, so write() can find the device.
+	i2C_file = HOST_I2C_FILE_BASE + address;
+	return 0;
+}
+
+int I2c::closeI2C() {
+	i2C_file = -1;
+	return 0;
+}
+
+int I2c::ioctl(int file, unsigned long request, struct i2c_rdwr_ioctl_data *data) {
+	if(request != I2C_RDWR) {
+		errno = EINVAL;
+		return -1;
+	}
+	bool hasRead = false;
+	for(unsigned int m = 0; m < data->nmsgs; m++) {
+		struct i2c_msg *msg = &data->msgs[m];
+		HostI2cDevice *device = deviceAt(msg->addr);
+		if(!device) {
+			errno = ENXIO;
+			return -1;
+		}
+		HostI2cStats& stats = gHostI2cStats[msg->addr];
+		stats.messages++;
+		if(msg->flags & I2C_M_RD) {
+			device->readBytes(msg->buf, msg->len);
+			stats.bytesRead += msg->len;
+			hasRead = true;
+		} else {
+			device->writeBytes(msg->buf, msg->len);
+			stats.bytesWritten += msg->len;
+		}
+	}
+	if(data->nmsgs > 0) {
+		HostI2cStats& stats = gHostI2cStats[data->msgs[0].addr];
+		stats.transactions++;
+		if(hasRead)
+			stats.readTransactions++;
+		else
+			stats.writeTransactions++;
+	}
+	return data->nmsgs;
+}
+
+ssize_t I2c::write(int file, const void *buf, size_t count) {
+	HostI2cDevice *device = deviceAt(file - HOST_I2C_FILE_BASE);
+	if(!device) {
+		errno = EBADF;
+		return -1;
+	}
+	device->writeBytes((const uint8_t *)buf, count);
+	HostI2cStats& stats = gHostI2cStats[file - HOST_I2C_FILE_BASE];
+	stats.transactions++;
+	stats.writeTransactions++;
+	stats.messages++;
+	stats.bytesWritten += count;
+	return count;
+}
+
+ssize_t I2c::read(int file, void *buf, size_t count) {
+	HostI2cDevice *device = deviceAt(file - HOST_I2C_FILE_BASE);
+	if(!device) {
+		errno = EBADF;
+		return -1;
+	}
+	device->readBytes((uint8_t *)buf, count);
+	HostI2cStats& stats = gHostI2cStats[file - HOST_I2C_FILE_BASE];
+	stats.transactions++;
+	stats.readTransactions++;
+	stats.messages++;
+	stats.bytesRead += count;
+	return count;
+}
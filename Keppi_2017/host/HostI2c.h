@@ -0,0 +1,38 @@
+/***** HostI2c.h *****/
+// The in-process I2C bus that host/I2c.h routes driver transactions to.
+
+#ifndef HOST_I2C_BUS_H_
+#define HOST_I2C_BUS_H_
+
+#include <stdint.h>
+
+class HostI2cDevice {
+public:
+	virtual ~HostI2cDevice() {}
+	// A write message: the first byte is the register address, the rest is data.
+	virtual void writeBytes(const uint8_t *buf, int len) = 0;
+	// A read message, starting at the register address set by the last write.
+	virtual void readBytes(uint8_t *buf, int len) = 0;
+};
+
+// Attach a device at an address. Pass NULL to detach.
+void HostI2c_attach(int address, HostI2cDevice *device);
+
+// Traffic to one address. A transaction is one ioctl(I2C_RDWR) or write() call,
+// and a message is one addressed part of it. Byte counts are payload only.
+struct HostI2cStats {
+	uint64_t transactions;
+	uint64_t readTransactions;		// Transactions with at least one read message
+	uint64_t writeTransactions;		// The rest
+	uint64_t messages;
+	uint64_t bytesWritten;
+	uint64_t bytesRead;
+};
+
+HostI2cStats HostI2c_getStats(int address);
+void HostI2c_resetStats(int address);
+// Time the traffic would keep the bus busy at the given clock: 9 bits per byte
+// (including the address byte of every message) plus start and stop conditions.
+double HostI2c_busTimeUs(const HostI2cStats& stats, double clockHz = 400000);
+
+#endif /* HOST_I2C_BUS_H_ */
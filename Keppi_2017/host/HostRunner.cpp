@@ -0,0 +1,121 @@
+/***** HostRunner.cpp *****/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "HostRunner.h"
+
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+HostRunner::HostRunner() : userData(NULL), lastNs(0) {
+	memset(&context, 0, sizeof(context));
+}
+
+bool HostRunner::setup(const HostSettings& settings, void *data) {
+	userData = data;
+
+	// Bela runs the analog channels at 44.1kHz with 4 channels, 22.05kHz with 8.
+	int analogFrames = settings.analogChannels <= 4 ? settings.periodSize : settings.periodSize / 2;
+
+	audioIn.assign(settings.periodSize * settings.audioInChannels, 0);
+	audioOut.assign(settings.periodSize * settings.audioOutChannels, 0);
+	analogIn.assign(analogFrames * settings.analogChannels, 0);
+	analogOut.assign(analogFrames * settings.analogChannels, 0);
+	// Every pin starts as an input, as it does on the board.
+	digital.assign(settings.periodSize, 0xFFFF);
+	digitalInputValues.assign(settings.periodSize, 0);
+
+	context.audioIn = &audioIn[0];
+	context.audioOut = &audioOut[0];
+	context.analogIn = &analogIn[0];
+	context.analogOut = &analogOut[0];
+	context.digital = &digital[0];
+	context.audioFrames = settings.periodSize;
+	context.audioInChannels = settings.audioInChannels;
+	context.audioOutChannels = settings.audioOutChannels;
+	context.audioSampleRate = settings.audioSampleRate;
+	context.analogFrames = analogFrames;
+	context.analogInChannels = settings.analogChannels;
+	context.analogOutChannels = settings.analogChannels;
+	context.analogSampleRate = settings.audioSampleRate * analogFrames / settings.periodSize;
+	context.digitalFrames = settings.periodSize;
+	context.digitalChannels = settings.digitalChannels;
+	context.digitalSampleRate = settings.audioSampleRate;
+	context.audioFramesElapsed = 0;
+	blockNs.clear();
+
+	if(!::setup(&context, userData))
+		return false;
+	// Anything setup() scheduled runs before the first block, as it would on
+	// the board while the audio device is starting.
+	Bela_runPendingAuxiliaryTasks();
+	return true;
+}
+
+void HostRunner::setDigitalInput(int channel, int value, int fromFrame) {
+	for(unsigned int n = fromFrame < 0 ? 0 : fromFrame; n < digitalInputValues.size(); n++) {
+		if(value)
+			digitalInputValues[n] |= 1 << channel;
+		else
+			digitalInputValues[n] &= ~(1 << channel);
+	}
+}
+
+void HostRunner::renderBlock() {
+	// Outputs hold their last value across blocks; inputs are re-sampled.
+	uint32_t last = digital[context.digitalFrames - 1];
+	uint32_t inputBits = (last & 0xFFFF) << 16;
+	for(unsigned int n = 0; n < context.digitalFrames; n++)
+		digital[n] = (last & ~inputBits) | ((digitalInputValues[n] << 16) & inputBits);
+	// Inputs hold their value at the end of the block until they're set again.
+	for(unsigned int n = 0; n < context.digitalFrames; n++)
+		digitalInputValues[n] = digitalInputValues[context.digitalFrames - 1];
+	memset(&audioOut[0], 0, audioOut.size() * sizeof(float));
+
+	int64_t start = nowNs();
+	::render(&context, userData);
+	lastNs = nowNs() - start;
+	blockNs.push_back(lastNs);
+
+	context.audioFramesElapsed += context.audioFrames;
+	Bela_runPendingAuxiliaryTasks();
+}
+
+void HostRunner::cleanup() {
+	::cleanup(&context, userData);
+	Bela_deleteAllAuxiliaryTasks();
+}
+
+static void putLE(FILE *file, uint32_t value, int bytes) {
+	for(int i = 0; i < bytes; i++)
+		fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+bool writeWavFile(const std::string& path, const std::vector<float>& samples, int channels, int sampleRate) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+	uint32_t dataBytes = samples.size() * sizeof(float);
+	fwrite("RIFF", 1, 4, file);
+	putLE(file, 36 + dataBytes, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	putLE(file, 16, 4);
+	putLE(file, 3, 2);	// IEEE float
+	putLE(file, channels, 2);
+	putLE(file, sampleRate, 4);
+	putLE(file, sampleRate * channels * sizeof(float), 4);
+	putLE(file, channels * sizeof(float), 2);
+	putLE(file, 32, 2);
+	fwrite("data", 1, 4, file);
+	putLE(file, dataBytes, 4);
+	for(unsigned int i = 0; i < samples.size(); i++) {
+		uint32_t bits;
+		memcpy(&bits, &samples[i], 4);
+		putLE(file, bits, 4);
+	}
+	return fclose(file) == 0;
+}
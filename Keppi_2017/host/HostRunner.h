@@ -0,0 +1,59 @@
+/***** HostRunner.h *****/
+/*
+ * Owns the buffers behind a host BelaContext and steps a project through
+ * setup(), render() and cleanup() one block at a time, timing each render().
+ */
+
+#ifndef HOST_RUNNER_H_
+#define HOST_RUNNER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <Bela.h>
+
+struct HostSettings {
+	int periodSize;			// Audio frames per block (-p)
+	float audioSampleRate;
+	int audioInChannels;
+	int audioOutChannels;
+	int analogChannels;		// Analog inputs/outputs (-C)
+	int digitalChannels;
+
+	HostSettings() : periodSize(16), audioSampleRate(44100), audioInChannels(2),
+		audioOutChannels(2), analogChannels(8), digitalChannels(16) {}
+};
+
+class HostRunner {
+public:
+	HostRunner();
+
+	bool setup(const HostSettings& settings, void *userData = NULL);
+	// Render one block. Fill analogInput() (and digital inputs) first.
+	void renderBlock();
+	void cleanup();
+
+	BelaContext *getContext() { return &context; }
+	float *analogInput() { return &analogIn[0]; }
+	const float *audioOutput() { return &audioOut[0]; }
+	// Set a digital input for the next block, from fromFrame on (it holds until set again).
+	void setDigitalInput(int channel, int value, int fromFrame = 0);
+
+	uint64_t framesElapsed() { return context.audioFramesElapsed; }
+	int64_t lastBlockNs() { return lastNs; }
+	const std::vector<int64_t>& blockTimes() { return blockNs; }
+
+private:
+	BelaContext context;
+	void *userData;
+	std::vector<float> audioIn, audioOut, analogIn, analogOut;
+	std::vector<uint32_t> digital;
+	std::vector<uint32_t> digitalInputValues;	// Per frame of the next block
+	int64_t lastNs;
+	std::vector<int64_t> blockNs;
+};
+
+// Writes interleaved 32-bit float samples as a WAV file. Returns false on error.
+bool writeWavFile(const std::string& path, const std::vector<float>& samples, int channels, int sampleRate);
+
+#endif /* HOST_RUNNER_H_ */
@@ -0,0 +1,191 @@
+/***** HostSndfile.cpp *****/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sndfile.h"
+
+struct SNDFILE_tag {
+	FILE *file;
+	SF_INFO info;
+	int bytesPerSample;
+	long dataOffset;
+	sf_count_t position; // in frames
+};
+
+static const char *gSndfileError = "No error.";
+
+static uint32_t readLE(const uint8_t *p, int bytes) {
+	uint32_t value = 0;
+	for(int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+SNDFILE *sf_open(const char *path, int mode, SF_INFO *sfinfo) {
+	if(mode != SFM_READ) {
+		gSndfileError = "Only SFM_READ is supported on the host.";
+		return NULL;
+	}
+	FILE *file = fopen(path, "rb");
+	if(!file) {
+		gSndfileError = "System error : No such file or directory.";
+		return NULL;
+	}
+	uint8_t riff[12];
+	if(fread(riff, 1, 12, file) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4)) {
+		gSndfileError = "File contains data in an unknown format.";
+		fclose(file);
+		return NULL;
+	}
+
+	int formatTag = 0, channels = 0, sampleRate = 0, bits = 0;
+	long dataOffset = -1;
+	uint32_t dataBytes = 0;
+	uint8_t chunk[8];
+	while(fread(chunk, 1, 8, file) == 8) {
+		uint32_t chunkSize = readLE(chunk + 4, 4);
+		if(!memcmp(chunk, "fmt ", 4)) {
+			uint8_t fmt[40] = { 0 };
+			uint32_t toRead = chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt);
+			if(fread(fmt, 1, toRead, file) != toRead)
+				break;
+			formatTag = readLE(fmt, 2);
+			channels = readLE(fmt + 2, 2);
+			sampleRate = readLE(fmt + 4, 4);
+			bits = readLE(fmt + 14, 2);
+			if(formatTag == 0xFFFE && toRead >= 26)	// WAVE_FORMAT_EXTENSIBLE
+				formatTag = readLE(fmt + 24, 2);
+			fseek(file, chunkSize - toRead + (chunkSize & 1), SEEK_CUR);
+		} else if(!memcmp(chunk, "data", 4)) {
+			dataOffset = ftell(file);
+			dataBytes = chunkSize;
+			break;
+		} else {
+			fseek(file, chunkSize + (chunkSize & 1), SEEK_CUR);
+		}
+	}
+
+	int subformat = 0;
+	if(formatTag == 1 && bits == 8) subformat = SF_FORMAT_PCM_U8;
+	else if(formatTag == 1 && bits == 16) subformat = SF_FORMAT_PCM_16;
+	else if(formatTag == 1 && bits == 24) subformat = SF_FORMAT_PCM_24;
+	else if(formatTag == 1 && bits == 32) subformat = SF_FORMAT_PCM_32;
+	else if(formatTag == 3 && bits == 32) subformat = SF_FORMAT_FLOAT;
+	else if(formatTag == 3 && bits == 64) subformat = SF_FORMAT_DOUBLE;
+	if(!subformat || channels <= 0 || dataOffset < 0) {
+		gSndfileError = "File contains data in an unimplemented format.";
+		fclose(file);
+		return NULL;
+	}
+
+	SNDFILE *sndfile = new SNDFILE;
+	sndfile->file = file;
+	sndfile->bytesPerSample = bits / 8;
+	sndfile->dataOffset = dataOffset;
+	sndfile->position = 0;
+	sndfile->info.frames = dataBytes / (sndfile->bytesPerSample * channels);
+	sndfile->info.samplerate = sampleRate;
+	sndfile->info.channels = channels;
+	sndfile->info.format = SF_FORMAT_WAV | subformat;
+	sndfile->info.sections = 1;
+	sndfile->info.seekable = 1;
+	*sfinfo = sndfile->info;
+	return sndfile;
+}
+
+int sf_close(SNDFILE *sndfile) {
+	if(!sndfile)
+		return 0;
+	fclose(sndfile->file);
+	delete sndfile;
+	return 0;
+}
+
+sf_count_t sf_seek(SNDFILE *sndfile, sf_count_t frames, int whence) {
+	sf_count_t target = frames;
+	if(whence == SEEK_CUR)
+		target += sndfile->position;
+	else if(whence == SEEK_END)
+		target += sndfile->info.frames;
+	if(target < 0 || target > sndfile->info.frames)
+		return -1;
+	sndfile->position = target;
+	fseek(sndfile->file, sndfile->dataOffset + target * sndfile->bytesPerSample * sndfile->info.channels, SEEK_SET);
+	return target;
+}
+
+static float decodeSample(const uint8_t *p, int subformat) {
+	switch(subformat) {
+		case SF_FORMAT_PCM_U8:
+			return ((int)p[0] - 128) / 128.0f;
+		case SF_FORMAT_PCM_16:
+			return (int16_t)readLE(p, 2) / 32768.0f;
+		case SF_FORMAT_PCM_24:
+			return ((int32_t)(readLE(p, 3) << 8) >> 8) / 8388608.0f;
+		case SF_FORMAT_PCM_32:
+			return (int32_t)readLE(p, 4) / 2147483648.0f;
+		case SF_FORMAT_FLOAT: {
+			uint32_t bits = readLE(p, 4);
+			float value;
+			memcpy(&value, &bits, 4);
+			return value;
+		}
+		case SF_FORMAT_DOUBLE: {
+			uint64_t bits = (uint64_t)readLE(p + 4, 4) << 32 | readLE(p, 4);
+			double value;
+			memcpy(&value, &bits, 8);
+			return value;
+		}
+	}
+	return 0;
+}
+
+sf_count_t sf_readf_float(SNDFILE *sndfile, float *ptr, sf_count_t frames) {
+	int channels = sndfile->info.channels;
+	int subformat = sndfile->info.format & SF_FORMAT_SUBMASK;
+	int frameBytes = sndfile->bytesPerSample * channels;
+	if(frames > sndfile->info.frames - sndfile->position)
+		frames = sndfile->info.frames - sndfile->position;
+
+	uint8_t chunk[4096];
+	int chunkFrames = sizeof(chunk) / frameBytes;
+	sf_count_t done = 0;
+	while(done < frames) {
+		sf_count_t todo = frames - done < chunkFrames ? frames - done : chunkFrames;
+		sf_count_t got = fread(chunk, frameBytes, todo, sndfile->file);
+		for(sf_count_t i = 0; i < got * channels; i++)
+			ptr[done * channels + i] = decodeSample(chunk + i * sndfile->bytesPerSample, subformat);
+		done += got;
+		if(got < todo)
+			break;
+	}
+	sndfile->position += done;
+	return done;
+}
+
+sf_count_t sf_read_float(SNDFILE *sndfile, float *ptr, sf_count_t items) {
+	return sf_readf_float(sndfile, ptr, items / sndfile->info.channels) * sndfile->info.channels;
+}
+
+int sf_command(SNDFILE *sndfile, int command, void *data, int datasize) {
+	if(command != SFC_CALC_SIGNAL_MAX || datasize != sizeof(double))
+		return 1;
+	sf_count_t savedPosition = sndfile->position;
+	sf_seek(sndfile, 0, SEEK_SET);
+	double max = 0;
+	float buf[1024];
+	sf_count_t got;
+	while((got = sf_read_float(sndfile, buf, 1024 - 1024 % sndfile->info.channels)) > 0) {
+		for(sf_count_t i = 0; i < got; i++)
+			if(fabs(buf[i]) > max)
+				max = fabs(buf[i]);
+	}
+	sf_seek(sndfile, savedPosition, SEEK_SET);
+	*(double *)data = max;
+	return 0;
+}
+
+const char *sf_strerror(SNDFILE *sndfile) {
+	return gSndfileError;
+}
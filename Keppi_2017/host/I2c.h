@@ -0,0 +1,46 @@
+/***** I2c.h (host) *****/
+/*
+ * Stand-in for Bela's I2c base class. The MPR121 drivers call ioctl() and
+ * write() unqualified from inside their member functions, so declaring them
+ * here as static members makes those calls resolve to the host bus below
+ * instead of the kernel, without touching the driver source. Devices are
+ * attached to the bus with HostI2c_attach() (see HostI2c.h).
+ */
+
+#ifndef HOST_I2C_H_
+#define HOST_I2C_H_
+
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "rtdk.h"
+
+using namespace std;
+
+class I2c
+{
+protected:
+	int i2C_bus;
+	int i2C_address;
+	int i2C_file;
+
+	static int ioctl(int file, unsigned long request, struct i2c_rdwr_ioctl_data *data);
+	static ssize_t write(int file, const void *buf, size_t count);
+	static ssize_t read(int file, void *buf, size_t count);
+
+public:
+	I2c() : i2C_bus(0), i2C_address(0), i2C_file(-1) {}
+	int initI2C_RW(int bus, int address, int file);
+	virtual int readI2C() = 0;
+	int closeI2C();
+	virtual ~I2c() {}
+};
+
+#endif /* HOST_I2C_H_ */
@@ -0,0 +1,257 @@
+/***** MPR121Sim.cpp *****/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "MPR121Sim.h"
+
+#define SIM_UNTOUCHED_DATA 720	// Filtered data of an idle electrode (10 bits)
+#define SIM_TOUCH_DELTA 80		// How far the data drops when firmly touched
+
+// Registers (the same names as I2C_MPR121.h, which the sim doesn't include)
+#define REG_TOUCHSTATUS_L 0x00
+#define REG_TOUCHSTATUS_H 0x01
+#define REG_FILTDATA_0L 0x04
+#define REG_BASELINE_0 0x1E
+#define REG_MHDR 0x2B
+#define REG_NHDR 0x2C
+#define REG_NCLR 0x2D
+#define REG_NHDF 0x30
+#define REG_NCLF 0x31
+#define REG_NHDT 0x33
+#define REG_NCLT 0x34
+#define REG_TOUCHTH_0 0x41
+#define REG_RELEASETH_0 0x42
+#define REG_CONFIG1 0x5C
+#define REG_CONFIG2 0x5D
+#define REG_ECR 0x5E
+#define REG_GPIO_FIRST 0x73
+#define REG_GPIO_LAST 0x7A
+#define REG_SOFTRESET 0x80
+
+MPR121Sim::MPR121Sim() {
+	now = 0;
+	nextSample = 0;
+	nextTimelineEntry = 0;
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++)
+		strength[e] = 0;
+	reset();
+}
+
+void MPR121Sim::reset() {
+	memset(registers, 0, sizeof(registers));
+	registers[REG_CONFIG1] = 0x10;
+	registers[REG_CONFIG2] = 0x24;	// begin() checks for this
+	registerPointer = 0;
+	touchStatus = 0;
+	irq = false;
+	loadBaseline = false;
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++) {
+		filtered[e] = SIM_UNTOUCHED_DATA + 3 * e;	// Electrodes aren't all alike
+		baseline[e] = 0;
+		baselineCount[e] = 0;
+	}
+	updateDataRegisters();
+}
+
+void MPR121Sim::setTouchStrength(int electrode, float value) {
+	if(electrode >= 0 && electrode < MPR121SIM_NUM_ELECTRODES)
+		strength[electrode] = std::min(std::max(value, 0.0f), 1.0f);
+}
+
+void MPR121Sim::setTouched(uint16_t mask) {
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++)
+		strength[e] = (mask & (1 << e)) ? 1 : 0;
+}
+
+void MPR121Sim::scheduleTouched(double time, uint16_t mask) {
+	TimelineEntry entry = { time, -1, 0, mask };
+	scheduleEntry(entry);
+}
+
+void MPR121Sim::scheduleTouchStrength(double time, int electrode, float value) {
+	TimelineEntry entry = { time, electrode, value, 0 };
+	scheduleEntry(entry);
+}
+
+// Keep the timeline in time order (entries at the same time stay in the order
+// they were added). Anything scheduled in the past applies at the next sample.
+void MPR121Sim::scheduleEntry(const TimelineEntry& entry) {
+	std::vector<TimelineEntry>::iterator position = std::upper_bound(
+		timeline.begin() + nextTimelineEntry, timeline.end(), entry,
+		[](const TimelineEntry& a, const TimelineEntry& b) { return a.time < b.time; });
+	timeline.insert(position, entry);
+}
+
+bool MPR121Sim::loadTimeline(const char *path, double frameRate) {
+	FILE *file = fopen(path, "r");
+	if(!file)
+		return false;
+	char line[256];
+	while(fgets(line, sizeof(line), file)) {
+		unsigned long long frame;
+		unsigned int first;
+		float value;
+		if(line[0] == '#')
+			continue;
+		int fields = sscanf(line, "%llu %i %f", &frame, &first, &value);
+		if(fields == 3)
+			scheduleTouchStrength(frame / frameRate, first, value);
+		else if(fields == 2)
+			scheduleTouched(frame / frameRate, first);
+	}
+	fclose(file);
+	return true;
+}
+
+void MPR121Sim::setData(uint16_t touched, const uint16_t *filteredData, const uint16_t *baselineData) {
+	if(touched != touchStatus)
+		irq = true;
+	touchStatus = touched & 0x0FFF;
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++) {
+		filtered[e] = filteredData[e] & 0x3FF;
+		baseline[e] = baselineData[e] & 0x3FC;
+	}
+	updateDataRegisters();
+}
+
+double MPR121Sim::samplePeriod() {
+	// CONFIG2 bits 2:0 (ESI) set the sample interval: 2^ESI ms.
+	return (1 << (registers[REG_CONFIG2] & 0x07)) * 0.001;
+}
+
+void MPR121Sim::advanceTo(double time) {
+	while(nextSample <= time) {
+		while(nextTimelineEntry < timeline.size() && timeline[nextTimelineEntry].time <= nextSample) {
+			const TimelineEntry& entry = timeline[nextTimelineEntry++];
+			if(entry.electrode < 0)
+				setTouched(entry.mask);
+			else
+				setTouchStrength(entry.electrode, entry.strength);
+		}
+		if(isRunning())
+			sampleElectrodes();
+		nextSample += samplePeriod();
+	}
+	now = time;
+}
+
+// One sample period of the chip in run mode: new filtered data, baseline
+// tracking and the touch/release decision for every enabled electrode.
+void MPR121Sim::sampleElectrodes() {
+	int numEnabled = std::min(registers[REG_ECR] & 0x0F, MPR121SIM_NUM_ELECTRODES);
+	int baselineLoad = registers[REG_ECR] >> 6;	// CL bits
+	uint16_t newStatus = touchStatus;
+
+	for(int e = 0; e < numEnabled; e++) {
+		filtered[e] = SIM_UNTOUCHED_DATA + 3 * e - (int)(strength[e] * SIM_TOUCH_DELTA);
+
+		if(loadBaseline) {
+			// CL = 10 loads the top 5 bits of the first sample, 11 all 10 bits.
+			if(baselineLoad == 2)
+				baseline[e] = filtered[e] & 0x3E0;
+			else if(baselineLoad == 3)
+				baseline[e] = filtered[e];
+			baselineCount[e] = 0;
+		}
+
+		bool touched = newStatus & (1 << e);
+		// Baseline tracking (not when CL = 01): once the data has been off the baseline
+		// for more than NCL samples, move the baseline NHD towards it. Touched electrodes
+		// use the touched set, which begin() leaves at zero, so they don't track.
+		if(baselineLoad != 1 && filtered[e] != baseline[e]) {
+			int noiseCount, step;
+			if(touched) {
+				noiseCount = registers[REG_NCLT];
+				step = registers[REG_NHDT];
+			} else if(filtered[e] > baseline[e]) {
+				noiseCount = registers[REG_NCLR];
+				step = std::max<int>(registers[REG_NHDR], registers[REG_MHDR]);
+			} else {
+				noiseCount = registers[REG_NCLF];
+				step = registers[REG_NHDF];
+			}
+			if(step > 0 && ++baselineCount[e] > noiseCount) {
+				int distance = std::min<int>(step, abs(filtered[e] - baseline[e]));
+				baseline[e] += filtered[e] > baseline[e] ? distance : -distance;
+				baselineCount[e] = 0;
+			}
+		} else {
+			baselineCount[e] = 0;
+		}
+
+		// Touched when the data drops more than the touch threshold below the
+		// baseline; released when it comes back within the release threshold.
+		int delta = (int)(baseline[e] & 0x3FC) - filtered[e];
+		if(!touched && delta > registers[REG_TOUCHTH_0 + 2 * e])
+			newStatus |= 1 << e;
+		else if(touched && delta < registers[REG_RELEASETH_0 + 2 * e])
+			newStatus &= ~(1 << e);
+	}
+	loadBaseline = false;
+
+	if(newStatus != touchStatus)
+		irq = true;
+	touchStatus = newStatus;
+	updateDataRegisters();
+}
+
+void MPR121Sim::updateDataRegisters() {
+	registers[REG_TOUCHSTATUS_L] = touchStatus & 0xFF;
+	registers[REG_TOUCHSTATUS_H] = (touchStatus >> 8) & 0x0F;
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++) {
+		registers[REG_FILTDATA_0L + 2 * e] = filtered[e] & 0xFF;
+		registers[REG_FILTDATA_0L + 2 * e + 1] = (filtered[e] >> 8) & 0x03;
+		registers[REG_BASELINE_0 + e] = baseline[e] >> 2;
+	}
+}
+
+void MPR121Sim::writeRegister(uint8_t reg, uint8_t value) {
+	MPR121SimWrite write = { reg, value };
+	writeLog.push_back(write);
+
+	if(reg == REG_SOFTRESET) {
+		if(value == 0x63)
+			reset();
+		return;
+	}
+	if(reg >= MPR121SIM_NUM_REGISTERS)
+		return;
+	// In run mode the chip only accepts writes to ECR (and the GPIO registers).
+	if(isRunning() && reg != REG_ECR && (reg < REG_GPIO_FIRST || reg > REG_GPIO_LAST))
+		return;
+	if(reg >= REG_BASELINE_0 && reg < REG_BASELINE_0 + MPR121SIM_NUM_ELECTRODES) {
+		baseline[reg - REG_BASELINE_0] = value << 2;
+	} else if(reg < REG_MHDR) {
+		return;	// Status and data registers are read only
+	} else if(reg == REG_ECR) {
+		bool wasRunning = isRunning();
+		registers[reg] = value;
+		if(!wasRunning && isRunning()) {
+			loadBaseline = true;
+		} else if(!isRunning()) {
+			touchStatus = 0;
+		}
+	} else {
+		registers[reg] = value;
+	}
+	updateDataRegisters();
+}
+
+void MPR121Sim::writeBytes(const uint8_t *buf, int len) {
+	if(len < 1)
+		return;
+	registerPointer = buf[0];
+	for(int i = 1; i < len; i++)
+		writeRegister(registerPointer++, buf[i]);
+}
+
+void MPR121Sim::readBytes(uint8_t *buf, int len) {
+	for(int i = 0; i < len; i++) {
+		uint8_t reg = registerPointer++;
+		if(reg == REG_TOUCHSTATUS_L || reg == REG_TOUCHSTATUS_H)
+			irq = false;
+		buf[i] = reg < MPR121SIM_NUM_REGISTERS ? registers[reg] : 0;
+	}
+}
@@ -0,0 +1,112 @@
+/***** MPR121Sim.h *****/
+/*
+ * A register-level model of the MPR121 for the host I2C bus, so that the
+ * I2C_MPR121 drivers (Keppi/ and Testing library/capTouch_tester/) run
+ * unmodified without /dev/i2c-*.
+ *
+ * It keeps the register file that begin() programs, and models each
+ * electrode's filtered data, baseline tracking and touch/release thresholds,
+ * so the touch status comes out of the same comparison the chip makes.
+ * As on the chip, configuration writes are ignored while it is in run mode.
+ * Touches are scripted on a timeline and played as the simulation clock is
+ * advanced. The IRQ output is asserted on any change of touch status and
+ * released when the status registers are read.
+ *
+ * The host bus counts every transaction and byte (HostI2c_getStats()), so
+ * the bus cost of a driver's poll can be measured; the sim keeps a log of
+ * every register write so begin()'s programming can be checked.
+ */
+
+#ifndef MPR121SIM_H_
+#define MPR121SIM_H_
+
+#include <stdint.h>
+#include <vector>
+#include "HostI2c.h"
+
+#define MPR121SIM_NUM_ELECTRODES 12
+#define MPR121SIM_NUM_REGISTERS 0x81
+
+struct MPR121SimWrite {
+	uint8_t reg;
+	uint8_t value;
+};
+
+class MPR121Sim : public HostI2cDevice {
+public:
+	MPR121Sim();
+
+	// Power-on / soft reset state.
+	void reset();
+
+	// How strongly an electrode is touched, from 0 (not at all) to 1 (firmly).
+	// Takes effect on the chip's next sample, as it would on the board.
+	void setTouchStrength(int electrode, float strength);
+	// Touch the electrodes in mask firmly and release the rest.
+	void setTouched(uint16_t mask);
+
+	// Timeline: changes to apply when the clock reaches a given time.
+	void scheduleTouched(double time, uint16_t mask);
+	void scheduleTouchStrength(double time, int electrode, float strength);
+	// Loads "<frame> <mask>" or "<frame> <electrode> <strength>" lines
+	// ('#' starts a comment), with frames at the given rate.
+	bool loadTimeline(const char *path, double frameRate);
+
+	// Replaces the data of the last sample with what a real chip read: the touch
+	// status, filtered data and baselines (shifted up to 10 bits, as readAll()
+	// gives them). For playing back a capture without advancing the clock.
+	void setData(uint16_t touched, const uint16_t *filteredData, const uint16_t *baselineData);
+
+	// Run the chip up to the given time (in seconds), sampling the
+	// electrodes every sample period, as set in CONFIG2.
+	void advanceTo(double time);
+
+	uint16_t getTouched() { return touchStatus; }
+	bool irqAsserted() { return irq; }
+	bool isRunning() { return (registers[0x5E] & 0x0F) != 0; }
+	uint8_t getRegister(uint8_t reg) { return reg < MPR121SIM_NUM_REGISTERS ? registers[reg] : 0; }
+	uint16_t getFiltered(int electrode) { return filtered[electrode]; }
+	uint16_t getBaseline(int electrode) { return baseline[electrode]; }
+
+	// Every register write, in order, including any the chip ignored.
+	const std::vector<MPR121SimWrite>& getWriteLog() { return writeLog; }
+	void clearWriteLog() { writeLog.clear(); }
+
+	// HostI2cDevice
+	void writeBytes(const uint8_t *buf, int len);
+	void readBytes(uint8_t *buf, int len);
+
+private:
+	struct TimelineEntry {
+		double time;
+		int electrode;	// -1: apply mask to all electrodes
+		float strength;
+		uint16_t mask;
+	};
+
+	void scheduleEntry(const TimelineEntry& entry);
+	void writeRegister(uint8_t reg, uint8_t value);
+	void sampleElectrodes();
+	void updateDataRegisters();
+	double samplePeriod();
+
+	uint8_t registers[MPR121SIM_NUM_REGISTERS];
+	uint8_t registerPointer;
+
+	float strength[MPR121SIM_NUM_ELECTRODES];
+	uint16_t filtered[MPR121SIM_NUM_ELECTRODES];	// 10 bits
+	uint16_t baseline[MPR121SIM_NUM_ELECTRODES];	// 10 bits; the chip reports the top 8
+	int baselineCount[MPR121SIM_NUM_ELECTRODES];	// Samples the data has been off the baseline
+	bool loadBaseline;								// Set on entering run mode
+	uint16_t touchStatus;
+	bool irq;
+
+	double now;
+	double nextSample;
+	std::vector<TimelineEntry> timeline;
+	unsigned int nextTimelineEntry;
+
+	std::vector<MPR121SimWrite> writeLog;
+};
+
+#endif /* MPR121SIM_H_ */
@@ -0,0 +1,14 @@
+/***** Scope.h (host) *****/
+// The browser scope has no meaning offline, so this one discards everything.
+
+#ifndef HOST_SCOPE_H_
+#define HOST_SCOPE_H_
+
+class Scope {
+public:
+	void setup(unsigned int numChannels, float sampleRate) {}
+	void log(float chn1, ...) {}
+	void log(float *values) {}
+};
+
+#endif /* HOST_SCOPE_H_ */
@@ -0,0 +1,16 @@
+/***** Utilities.h (host) *****/
+
+#ifndef HOST_UTILITIES_H_
+#define HOST_UTILITIES_H_
+
+static inline float map(float x, float in_min, float in_max, float out_min, float out_max) {
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+static inline float constrain(float x, float min_val, float max_val) {
+	if(x < min_val) return min_val;
+	if(x > max_val) return max_val;
+	return x;
+}
+
+#endif /* HOST_UTILITIES_H_ */
@@ -0,0 +1,43 @@
+/***** WriteFile.h (host) *****/
+// Writes straight to disk: there is no real-time thread to protect offline.
+
+#ifndef HOST_WRITEFILE_H_
+#define HOST_WRITEFILE_H_
+
+#include <stdio.h>
+#include <string>
+
+typedef enum {
+	kBinary,
+	kText
+} WriteFileType;
+
+class WriteFile {
+public:
+	WriteFile() : file(NULL), fileType(kText), format("%.4f ") {}
+	~WriteFile() { if(file) fclose(file); }
+
+	void init(const char *filename) { file = fopen(filename, "w"); }
+	void setFileType(WriteFileType newFileType) { fileType = newFileType; }
+	void setFormat(const char *newFormat) { format = newFormat; }
+
+	void log(float value) { log(&value, 1); }
+	void log(const float *array, int length) {
+		if(!file)
+			return;
+		if(fileType == kBinary) {
+			fwrite(array, sizeof(float), length, file);
+		} else {
+			for(int n = 0; n < length; n++)
+				fprintf(file, format.c_str(), array[n]);
+		}
+	}
+	void log() {}
+
+private:
+	FILE *file;
+	WriteFileType fileType;
+	std::string format;
+};
+
+#endif /* HOST_WRITEFILE_H_ */
@@ -0,0 +1,191 @@
+/***** accel_bench.cpp *****/
+/*
+ * Times Keppi's accelerometer pipeline (Keppi/accelerometer.hpp) at a few
+ * control rates, and checks that the lights still follow the motion as they
+ * do at the full analog rate.
+ *
+ *   accel_bench [-d decimation] [-s seconds]
+ *
+ * The input is a scripted half minute of the instrument sitting still, being
+ * shaken hard, shaken gently and tapped, so the lights go up and down through
+ * every state and the mute. It's run through readAccelerometer() at
+ * accelDecimation = 1 (the full rate) and then at each of 4, 8, 16, 32, 64,
+ * or just at -d.
+ *
+ * For each it prints the time per analog frame, the number of light state
+ * changes, and how far the changes are from where they happen at the full
+ * rate (if they are the same changes at all). A step measures the motion
+ * over its frames as a straight line, so shaking that curves within a step
+ * reads a little less; where the motion only just outruns gRolloff (the
+ * gentle shake) that moves the lights by a lot more than elsewhere.
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <Bela.h>
+#include "defs.hpp"
+#ifndef DISABLE_EVENT_LOG
+#define DISABLE_EVENT_LOG	// Nothing drains it here
+#endif
+#include "eventLog.hpp"
+#include "accelerometer.hpp"
+#include "coeffs.hpp"
+
+using namespace std;
+
+#define BENCH_CHANNELS 8	// Analog inputs, the accelerometer on 4-6
+
+int gIsAudioMuted = 0;
+int ledPins[5] = {0, 2, 4, 6, 7};
+
+struct LightChange {
+	int frame;
+	int state;
+};
+
+// A stretch of the script: shaking at freq Hz, amplitude amp on each axis (0 is still).
+struct Segment {
+	float seconds;
+	float freq;
+	float amp;
+};
+
+static const Segment kScript[] = {
+	{ 5, 0, 0 },		// Still: the lights run down from full and it mutes
+	{ 2, 6, 0.1f },		// Shaken hard: back up to full
+	{ 6, 0, 0 },
+	{ 3, 3, 0.03f },		// Shaken gently: part way up
+	{ 5, 0, 0 },
+	{ 0.05f, 20, 0.2f },	// A tap
+	{ 4, 0, 0 },
+	{ 0.05f, 20, 0.2f },	// Two taps
+	{ 0.3f, 0, 0 },
+	{ 0.05f, 20, 0.2f },
+	{ 5, 0, 0 },
+};
+
+// Fill an interleaved analog buffer with the script, with a little noise on every input.
+static void makeInput(vector<float>& input, int& numFrames) {
+	numFrames = 0;
+	for (unsigned int s = 0; s < sizeof(kScript) / sizeof(kScript[0]); s++)
+		numFrames += kScript[s].seconds * SAMPLE_RATE;
+	input.assign((size_t)numFrames * BENCH_CHANNELS, 0);
+	srand(1);
+	int frame = 0;
+	for (unsigned int s = 0; s < sizeof(kScript) / sizeof(kScript[0]); s++) {
+		int end = frame + (int)(kScript[s].seconds * SAMPLE_RATE);
+		for (int start = frame; frame < end; frame++) {
+			float t = (frame - start) / SAMPLE_RATE;
+			for (int c = 0; c < BENCH_CHANNELS; c++) {
+				float noise = (rand() / (float)RAND_MAX - 0.5f) * 0.002f;
+				float shake = kScript[s].amp * sin(2 * M_PI * kScript[s].freq * t + c);
+				input[(size_t)frame * BENCH_CHANNELS + c] = 0.5f + noise + shake;
+			}
+		}
+	}
+}
+
+// Run the input through the accelerometer at the given decimation, as render() does (once per
+// analog frame, at every other audio frame). Returns the ns per analog frame and, if changes
+// isn't NULL, the light state changes.
+static double runInput(const vector<float>& input, int numFrames, int decimation, vector<LightChange> *changes) {
+	accelDecimation = decimation;
+	setupAccelerometer(SAMPLE_RATE);
+	gPeak = 2;
+	gLightState = gPrevLightState = 0;
+	gMuteTimeout = 0;
+	gIsAudioMuted = 0;
+
+	uint32_t digital[1] = { 0 };
+	BelaContext context = BelaContext();
+	context.analogIn = input.data();
+	context.analogInChannels = BENCH_CHANNELS;
+	context.analogFrames = numFrames;
+	context.audioFrames = numFrames * 2;
+	context.digital = digital;
+	context.digitalFrames = 0;	// The lights go nowhere
+
+	int state = gLightState;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < numFrames; frame++) {
+		readAccelerometer(&context, frame * 2);
+		if (changes && gLightState != state) {
+			LightChange change = { frame, gLightState };
+			changes->push_back(change);
+		}
+		state = gLightState;
+	}
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / numFrames;
+}
+
+void usage(const char *processName)
+{
+	cerr << "Usage: " << processName << " [-d decimation] [-s seconds]\n";
+	cerr << "   -d decimation: Only compare this accelDecimation with the full rate\n";
+	cerr << "   -s seconds:    Length of input to time per case (default 120)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	vector<int> decimations = { 1, 4, 8, 16, 32, 64 };
+	float seconds = 120;
+	int c;
+	while ((c = getopt(argc, argv, "d:s:h")) >= 0) {
+		switch (c) {
+		case 'd': decimations = { 1, atoi(optarg) }; break;
+		case 's': seconds = atof(optarg); break;
+		default:
+			usage(basename(argv[0]));
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (decimations.back() < 1) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+	vector<float> input;
+	int numFrames;
+	makeInput(input, numFrames);
+	int repeats = ceil(seconds * SAMPLE_RATE / numFrames);
+	double budget = 1e9 / SAMPLE_RATE;	// ns of audio thread per analog frame
+
+	vector<LightChange> reference;
+	printf("%.1f seconds of motion at %.0fHz, timed over %d runs\n", numFrames / SAMPLE_RATE, SAMPLE_RATE, repeats);
+	printf("  %10s %10s %10s %8s %9s %12s\n", "decimation", "rate (Hz)", "ns/frame", "% audio", "changes", "max offset");
+	for (unsigned int i = 0; i < decimations.size(); i++) {
+		int decimation = decimations[i];
+		vector<LightChange> changes;
+		runInput(input, numFrames, decimation, &changes);
+		double ns = 0;
+		for (int r = 0; r < repeats; r++)
+			ns += runInput(input, numFrames, decimation, NULL) / repeats;
+		if (decimation == 1 && reference.empty())
+			reference = changes;
+
+		char offset[32];
+		bool same = changes.size() == reference.size();
+		int maxOffset = 0;
+		for (unsigned int n = 0; same && n < changes.size(); n++) {
+			same = changes[n].state == reference[n].state;
+			maxOffset = max(maxOffset, abs(changes[n].frame - reference[n].frame));
+		}
+		if (same)
+			snprintf(offset, sizeof(offset), "%.1f ms", maxOffset * 1000 / SAMPLE_RATE);
+		else
+			snprintf(offset, sizeof(offset), "differ");
+		printf("  %10d %10.0f %10.2f %8.3f %9d %12s\n", decimation, SAMPLE_RATE / decimation, ns,
+			ns / budget * 100, (int)changes.size(), offset);
+	}
+
+	printf("Light states at the full rate:");
+	for (unsigned int n = 0; n < reference.size(); n++)
+		printf(" %d@%.2fs", reference[n].state, reference[n].frame / SAMPLE_RATE);
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,117 @@
+/***** filter_bench.cpp *****/
+/*
+ * Times the filters in Keppi/filters.hpp in float and in double, for a few
+ * channel counts, filtering a block of frames at a time straight from an
+ * interleaved buffer like context->analogIn.
+ *
+ *   filter_bench [-p frames] [-s seconds]
+ *
+ * It needs nothing but filters.hpp, so it can be built on the board too, to
+ * compare float and double where it matters:
+ *
+ *   g++ -O3 -march=armv7-a -mtune=cortex-a8 -mfloat-abi=hard -mfpu=neon \
+ *       -std=c++11 -I../Keppi -o filter_bench filter_bench.cpp
+ *
+ * Prints the time per channel per frame for each filter, type and channel count.
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "filters.hpp"
+
+using namespace std;
+
+#define BENCH_INPUT_CHANNELS 8	// Interleaved input channels, as on the board's analog inputs
+#define BENCH_INPUT_FRAMES 22050	// Cycled through, so the input doesn't repeat every block
+
+// Time filter over seconds' worth of frames at 22.05kHz, period frames per call, in ns per channel-frame.
+template <class Filter, typename T, int N>
+static double timeFilter(Filter& filter, const vector<float>& input, int period, float seconds) {
+	vector<T> out(period * N);
+	int numFrames = seconds * 22050;
+	int frame = 0;
+	volatile T sink = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int done = 0; done < numFrames; done += period) {
+		if (frame + period > BENCH_INPUT_FRAMES)
+			frame = 0;
+		filter.process(input.data() + frame * BENCH_INPUT_CHANNELS, BENCH_INPUT_CHANNELS, out.data(), N, period);
+		sink = sink + out[0];
+		frame += period;
+	}
+	double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	return ns / numFrames / N;
+}
+
+template <int N>
+static void benchChannels(const vector<float>& input, int period, float seconds) {
+	Biquad<float, N> biquadFloat;
+	Biquad<double, N> biquadDouble;
+	DCBlocker<float, N> dcFloat;
+	DCBlocker<double, N> dcDouble;
+	OnePole<float, N> onePoleFloat;
+	OnePole<double, N> onePoleDouble;
+	// The accelerometer's lowpass (30Hz at 22.05kHz) and DC blocker.
+	biquadFloat.setCoefficients(1.77e-5, 3.54e-5, 1.77e-5, -1.988, 0.988);
+	biquadDouble.setCoefficients(1.77e-5, 3.54e-5, 1.77e-5, -1.988, 0.988);
+	dcFloat.setup(0.9998);
+	dcDouble.setup(0.9998);
+	onePoleFloat.setCutoff(30, 22050);
+	onePoleDouble.setCutoff(30, 22050);
+
+	printf("  %d channel%s\n", N, N == 1 ? "" : "s");
+	printf("    %-12s %8.2f %8.2f\n", "biquad",
+		timeFilter<Biquad<float, N>, float, N>(biquadFloat, input, period, seconds),
+		timeFilter<Biquad<double, N>, double, N>(biquadDouble, input, period, seconds));
+	printf("    %-12s %8.2f %8.2f\n", "DC blocker",
+		timeFilter<DCBlocker<float, N>, float, N>(dcFloat, input, period, seconds),
+		timeFilter<DCBlocker<double, N>, double, N>(dcDouble, input, period, seconds));
+	printf("    %-12s %8.2f %8.2f\n", "one-pole",
+		timeFilter<OnePole<float, N>, float, N>(onePoleFloat, input, period, seconds),
+		timeFilter<OnePole<double, N>, double, N>(onePoleDouble, input, period, seconds));
+}
+
+void usage(const char *processName)
+{
+	cerr << "Usage: " << processName << " [-p frames] [-s seconds]\n";
+	cerr << "   -p frames:   Frames per call, i.e. analog frames per block (default 8)\n";
+	cerr << "   -s seconds:  Length of input to filter per case (default 60)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	int period = 8;
+	float seconds = 60;
+	int c;
+	while ((c = getopt(argc, argv, "p:s:h")) >= 0) {
+		switch (c) {
+		case 'p': period = atoi(optarg); break;
+		case 's': seconds = atof(optarg); break;
+		default:
+			usage(basename(argv[0]));
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (period < 1 || period > BENCH_INPUT_FRAMES) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	vector<float> input(BENCH_INPUT_FRAMES * BENCH_INPUT_CHANNELS);
+	srand(1);
+	for (unsigned int n = 0; n < input.size(); n++)
+		input[n] = rand() / (float)RAND_MAX;
+
+	printf("ns per channel per frame, %d frames per call:\n", period);
+	printf("    %-12s %8s %8s\n", "", "float", "double");
+	benchChannels<1>(input, period, seconds);
+	benchChannels<3>(input, period, seconds);
+	benchChannels<4>(input, period, seconds);
+	benchChannels<8>(input, period, seconds);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/***** interp_bench.cpp *****/
+/*
+ * Times Keppi's mixer (Keppi/mixer.hpp) per voice at each playback quality:
+ * a frame per frame (no interpolation), linear and cubic interpolation, with
+ * samples stored as floats and as 16 bit. Voices are mixed through
+ * mixVoicesUpTo() a block at a time, as render() does, so the numbers include
+ * the voice bookkeeping.
+ *
+ *   interp_bench [-r rate] [-v voices] [-p period] [-s seconds]
+ *
+ * (-r is frames of sample per frame of output; the default, 96000/44100, is
+ * the kit's samples played at their own rate on the board.)
+ *
+ * For each case it prints the time per voice per frame and how many voices
+ * would fill the audio thread's whole budget at 44.1kHz.
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <SampleData.h>
+#include "defs.hpp"
+#include "sampleCache.hpp"
+#include "voices.hpp"
+#include "mixer.hpp"
+
+using namespace std;
+
+#define BENCH_SAMPLE_FRAMES 400000
+#define BENCH_SAMPLE_RATE 44100
+
+SampleData gSampleData[NUM_SAMPLES];
+int useStreaming = 0;
+
+// Nothing here streams.
+void mixStreamingVoice(int v, SampleData *sample, float *out, float gain, int count) {}
+void mixStreamingVoiceResampled(int v, SampleData *sample, float *out, float gain, int count) {}
+void streamStop(int v) {}
+
+struct BenchCase {
+	const char *name;
+	bool int16;
+	bool resampled;
+	int quality;
+};
+
+static const BenchCase kCases[] = {
+	{ "float, 1:1", false, false, kInterpolationLinear },
+	{ "float, linear", false, true, kInterpolationLinear },
+	{ "float, cubic", false, true, kInterpolationCubic },
+	{ "int16, 1:1", true, false, kInterpolationLinear },
+	{ "int16, linear", true, true, kInterpolationLinear },
+	{ "int16, cubic", true, true, kInterpolationCubic },
+};
+
+// Mix numVoices voices for numFrames frames, restarting any that finish, and return the time in ns.
+static double runCase(int numVoices, float rate, int period, int numFrames) {
+	gVoices.clear(numVoices);
+	for (int v = 0; v < numVoices; v++) {
+		int stole;
+		int voice = gVoices.allocate(&stole);
+		gVoices.start(voice, 0, 0.5f, 0);
+		gVoices.rate[voice] = rate;
+		// Spread them through the sample, so they don't all restart at once.
+		gVoices.readPointer[voice] = (int64_t)BENCH_SAMPLE_FRAMES * v / numVoices / 2;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < numFrames; frame += period) {
+		mixerStartBlock(period);
+		mixVoicesUpTo(period);
+		while (gVoices.numActive < numVoices) {
+			int stole;
+			int voice = gVoices.allocate(&stole);
+			gVoices.start(voice, 0, 0.5f, frame);
+			gVoices.rate[voice] = rate;
+		}
+	}
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+void usage(const char *processName)
+{
+	cerr << "Usage: " << processName << " [-r rate] [-v voices] [-p period] [-s seconds]\n";
+	cerr << "   -r rate:     Frames of sample per frame of output (default 96000/44100)\n";
+	cerr << "   -v voices:   Voices sounding at once (default " << DEFAULT_VOICES << ", at most " << MAX_VOICES << ")\n";
+	cerr << "   -p period:   Audio frames per block (default 16)\n";
+	cerr << "   -s seconds:  Length of output to mix per case (default 20)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	float rate = 96000.0f / 44100.0f;
+	int numVoices = DEFAULT_VOICES;
+	int period = 16;
+	float seconds = 20;
+	int c;
+	while ((c = getopt(argc, argv, "r:v:p:s:h")) >= 0) {
+		switch (c) {
+		case 'r': rate = atof(optarg); break;
+		case 'v': numVoices = atoi(optarg); break;
+		case 'p': period = atoi(optarg); break;
+		case 's': seconds = atof(optarg); break;
+		default:
+			usage(basename(argv[0]));
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (numVoices < 1 || numVoices > MAX_VOICES || period < 1 || rate <= 0) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	// Noise, so nothing is faster for being silent.
+	float *samples = new float[BENCH_SAMPLE_FRAMES];
+	srand(1);
+	for (int n = 0; n < BENCH_SAMPLE_FRAMES; n++)
+		samples[n] = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+	gMixBuffer = new float[period];
+	int numFrames = seconds * BENCH_SAMPLE_RATE;
+	double budget = 1e9 / BENCH_SAMPLE_RATE;	// ns of audio thread per frame
+
+	printf("%d voices, rate %.4f, %d-frame blocks, %d frames per case\n", numVoices, rate, period, numFrames);
+	printf("  %-14s %14s %14s\n", "", "ns/voice/frame", "voices in 100%");
+	for (unsigned int i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+		const BenchCase& bench = kCases[i];
+		SampleData& sample = gSampleData[0];
+		sample = SampleData();
+		sample.samples = samples;
+		sample.sampleLen = sample.residentLen = BENCH_SAMPLE_FRAMES;
+		sample.sampleRate = BENCH_SAMPLE_RATE;
+		if (bench.int16) {
+			float *copy = new float[BENCH_SAMPLE_FRAMES];
+			for (int n = 0; n < BENCH_SAMPLE_FRAMES; n++)
+				copy[n] = samples[n];
+			sample.samples = copy;
+			convertSampleToInt16(&sample);
+		}
+		interpolationQuality = bench.quality;
+
+		runCase(numVoices, bench.resampled ? rate : 1.0f, period, BENCH_SAMPLE_RATE);	// Warm up
+		double ns = runCase(numVoices, bench.resampled ? rate : 1.0f, period, numFrames);
+		double perVoiceFrame = ns / numFrames / numVoices;
+		printf("  %-14s %14.2f %14.0f\n", bench.name, perVoiceFrame, budget / perVoiceFrame);
+
+		if (bench.int16)
+			delete[] sample.samples16;
+	}
+	delete[] samples;
+	delete[] gMixBuffer;
+	return 0;
+}
@@ -0,0 +1,538 @@
+/***** keppi_bench.cpp *****/
+/*
+ * Scenario benchmarks for the whole of Keppi: the real setup(), render() and
+ * cleanup(), with the samples from the project folder, fed scripted playing
+ * through the simulated MPR121 and synthetic piezo and accelerometer input
+ * (or recorded playing, from captures, see Keppi/capture.hpp).
+ *
+ *   keppi_bench [-P project] [-g golden] [-n runs] [-v voices] [-u] [-l] [scenario | capture.kcap ...]
+ *   keppi_bench [-P project] [-n runs] -c
+ *
+ * With no arguments it runs every built-in scenario (-l lists them). Each run
+ * is a fresh process, as Keppi keeps its state in globals. For each scenario
+ * it prints render()'s mean time per frame and its worst block against the
+ * block deadline (the best of the runs), the most voices sounding at once
+ * (and the mean), and a hash of the audio output, which is checked against
+ * the one stored for the scenario in the golden file (bench_golden.txt). It
+ * exits with an error if any hash differs from the stored one, or between runs.
+ *
+ * After a change that is meant to change the sound, -u stores the new hashes.
+ * The hashes are of the default host build (make) at DEFAULT_VOICES; other
+ * compilers or flags may round differently, and other polyphonies (-v) aren't
+ * checked.
+ *
+ * -c runs the dense scenario at polyphonies from 1 to MAX_VOICES instead, and
+ * prints the cost of a block against the number of voices, to see how many
+ * the board can afford before they have to be stolen.
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "HostRunner.h"
+#include "HostCapture.h"
+#include "MPR121Sim.h"
+#include "rtdk.h"
+#include "defs.hpp"
+// The voice pool's layout, to see how many voices are sounding (the pool itself is render.cpp's).
+#define gVoices gBenchVoicesUnused
+#include "voices.hpp"
+#undef gVoices
+
+using namespace std;
+
+extern VoicePool gVoices;
+extern int useInterrupt;
+extern int interruptPin;
+extern int numVoices;
+
+#define BENCH_ANALOG_CHANNELS 8
+#define BENCH_ANALOG_RATE 22050.0
+#define BENCH_HIT_SECONDS 0.04		// How long a pad is touched, and its piezo rings, per hit
+
+// Scripted input: the analog inputs and the touches.
+struct ScenarioInput {
+	float seconds;
+	vector<float> analog;		// BENCH_ANALOG_CHANNELS interleaved at BENCH_ANALOG_RATE
+	MPR121Sim *mpr121;
+	uint32_t noise;
+
+	ScenarioInput(float length, MPR121Sim *sim) : seconds(length), mpr121(sim), noise(1) {
+		analog.assign((size_t)(seconds * BENCH_ANALOG_RATE) * BENCH_ANALOG_CHANNELS, 0);
+		still(0, seconds);
+	}
+
+	// Our own generator, so the input is the same whatever the C library.
+	float nextNoise() {
+		noise = noise * 1664525 + 1013904223;
+		return (noise >> 8) / (float)(1 << 24) - 0.5f;
+	}
+
+	float& at(double time, int channel) {
+		return analog[(size_t)(time * BENCH_ANALOG_RATE) * BENCH_ANALOG_CHANNELS + channel];
+	}
+
+	int frames(double from, double to) {
+		return (int)(min(to, (double)seconds) * BENCH_ANALOG_RATE) - (int)(from * BENCH_ANALOG_RATE);
+	}
+
+	// The instrument lying still (the accelerometer at rest), from..to seconds.
+	void still(double from, double to) {
+		for (int n = 0; n < frames(from, to); n++)
+			for (int c = 4; c < 7; c++)
+				at(from + n / BENCH_ANALOG_RATE, c) = 0.5f + 0.001f * nextNoise();
+	}
+
+	// The instrument being shaken, enough to keep the lights up.
+	void shake(double from, double to) {
+		for (int n = 0; n < frames(from, to); n++) {
+			double t = n / BENCH_ANALOG_RATE;
+			for (int c = 4; c < 7; c++)
+				at(from + t, c) = 0.5f + 0.1f * sin(2 * M_PI * 6 * t + c) + 0.001f * nextNoise();
+		}
+	}
+
+	// A hit on a pad: touched for BENCH_HIT_SECONDS, and a decaying knock on its piezo.
+	void hit(double time, int pad, float strength) {
+		mpr121->scheduleTouchStrength(time, pad, 1);
+		mpr121->scheduleTouchStrength(time + BENCH_HIT_SECONDS, pad, 0);
+		for (int n = 0; n < frames(time, time + BENCH_HIT_SECONDS); n++) {
+			double t = n / BENCH_ANALOG_RATE;
+			at(time + t, pad) += strength * 0.04f * exp(-t / 0.008) * sin(2 * M_PI * 180 * t);
+		}
+	}
+};
+
+struct Scenario {
+	const char *name;
+	const char *description;
+	float seconds;
+	void (*play)(ScenarioInput& input);
+};
+
+static void playIdle(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+}
+
+static void playSingleHit(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	input.hit(1, 0, 1);
+}
+
+// A hit every 200ms: the samples last longer than the 4s it takes to start 20.
+static void playAllVoices(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	for (int h = 0; h < DEFAULT_VOICES; h++)
+		input.hit(0.5 + 0.2 * h, h % NUM_TOUCH_PINS, 0.5f + 0.025f * h);
+}
+
+// A hit every 100ms for the whole scenario: after the first 20, every one steals.
+static void playStealing(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	int h = 0;
+	for (double t = 0.5; t < input.seconds - 0.5; t += 0.1, h++)
+		input.hit(t, h % NUM_TOUCH_PINS, 0.4f + 0.1f * (h % 7));
+}
+
+// One pad, as fast as the MPR121 sees the touches come and go.
+static void playRoll(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	int h = 0;
+	for (double t = 0.5; t < input.seconds - 0.5; t += 2 * BENCH_HIT_SECONDS, h++)
+		input.hit(t, 0, 0.3f + 0.05f * (h % 10));
+}
+
+static void playFourPads(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	for (double t = 0.5; t < input.seconds - 0.5; t += 1)
+		for (int p = 0; p < NUM_TOUCH_PINS; p++)
+			input.hit(t, p, 1);
+}
+
+// Lying still long enough for the lights to run down and mute, hit while muted, shaken awake
+// and hit again, then still until it mutes again.
+static void playMuteUnmute(ScenarioInput& input) {
+	input.still(0, 5);
+	input.shake(5, 7);
+	input.still(7, input.seconds);
+	double hits[] = { 1, 2, 3, 4.5, 6, 7.5, 12.5 };
+	for (unsigned int h = 0; h < sizeof(hits) / sizeof(hits[0]); h++)
+		input.hit(hits[h], h % NUM_TOUCH_PINS, 1);
+}
+
+// Every pad rolled, a hit every 20ms between them: the samples last long enough that this
+// keeps MAX_VOICES sounding.
+static void playDense(ScenarioInput& input) {
+	input.shake(0, input.seconds);
+	int h = 0;
+	for (double t = 0.5; t < input.seconds - 0.5; t += BENCH_HIT_SECONDS / 2, h++)
+		input.hit(t, h % NUM_TOUCH_PINS, 0.3f + 0.05f * (h % 10));
+}
+
+static const Scenario kScenarios[] = {
+	{ "idle", "no hits, lights up", 10, playIdle },
+	{ "single-hit", "one hit on pad 0", 10, playSingleHit },
+	{ "all-voices", "20 hits 200ms apart, all sounding at once", 10, playAllVoices },
+	{ "stealing", "a hit every 100ms, stealing from the 21st on", 10, playStealing },
+	{ "roll", "pad 0 every 80ms", 6, playRoll },
+	{ "four-pads", "all four pads at once, every second", 10, playFourPads },
+	{ "mute-unmute", "still until muted, hits while muted, shaken awake, muted again", 13, playMuteUnmute },
+	{ "dense", "a hit every 20ms across all pads (the -c scenario)", 8, playDense },
+};
+
+// The polyphonies -c runs dense at.
+static const int kCurveVoices[] = { 1, 2, 4, 8, 12, 16, 20, 24, 32, 48, 64, 96, 128 };
+
+struct RunResult {
+	uint64_t frames;
+	uint64_t blocks;
+	int64_t totalNs;
+	int64_t worstNs;
+	double deadlineNs;
+	uint64_t hash;
+	int peakVoices;
+	double meanVoices;
+	bool ok;
+};
+
+// FNV-1a over the bits of the output.
+static uint64_t hashOutput(uint64_t hash, const float *samples, int count) {
+	const uint8_t *bytes = (const uint8_t *)samples;
+	for (unsigned int i = 0; i < count * sizeof(float); i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// Run a scenario (or, if capturePath isn't NULL, a capture) through Keppi. Call in a process of its own.
+static RunResult runScenario(const Scenario *scenario, const char *capturePath, int voices) {
+	RunResult result = RunResult();
+	numVoices = voices;
+	HostSettings settings;
+	MPR121Sim mpr121Sim;
+	HostI2c_attach(0x5A, &mpr121Sim);
+
+	vector<float> analog;
+	CaptureHeader captureHeader;
+	vector<CapturedRead> capturedReads;
+	float seconds;
+	if (capturePath) {
+		if (!loadCapture(capturePath, BENCH_ANALOG_CHANNELS, captureHeader, analog, capturedReads))
+			return result;
+		settings.periodSize = captureHeader.audioFrames;
+		useInterrupt = captureHeader.useInterrupt;
+		seconds = 0;
+	} else {
+		ScenarioInput input(scenario->seconds, &mpr121Sim);
+		scenario->play(input);
+		analog.swap(input.analog);
+		seconds = scenario->seconds;
+	}
+
+	HostRunner runner;
+	if (!runner.setup(settings))
+		return result;
+	BelaContext *context = runner.getContext();
+	int analogSamplesPerBlock = context->analogFrames * context->analogInChannels;
+	uint64_t numBlocks;
+	if (capturePath)
+		numBlocks = analog.size() / analogSamplesPerBlock;
+	else
+		numBlocks = (uint64_t)(seconds * context->audioSampleRate) / context->audioFrames;
+
+	result.hash = 0xCBF29CE484222325ULL;
+	unsigned int nextRead = 0;
+	for (uint64_t block = 0; block < numBlocks; block++) {
+		uint64_t start = runner.framesElapsed();
+		if (capturePath) {
+			// As render_offline plays captures.
+			runner.setDigitalInput(interruptPin, 1);
+			if (nextRead < capturedReads.size() && capturedReads[nextRead].frame < start + context->audioFrames) {
+				const CapturedRead& read = capturedReads[nextRead++];
+				mpr121Sim.setData(read.data.touched, read.data.filtered, read.data.baseline);
+				runner.setDigitalInput(interruptPin, 0, read.frame > start ? read.frame - start : 0);
+			}
+		} else {
+			mpr121Sim.advanceTo(start / (double)context->audioSampleRate);
+			runner.setDigitalInput(interruptPin, !mpr121Sim.irqAsserted());
+		}
+		float *analogIn = runner.analogInput();
+		size_t offset = block * analogSamplesPerBlock;
+		for (int i = 0; i < analogSamplesPerBlock; i++)
+			analogIn[i] = offset + i < analog.size() ? analog[offset + i] : 0;
+
+		runner.renderBlock();
+
+		result.hash = hashOutput(result.hash, runner.audioOutput(), context->audioFrames * context->audioOutChannels);
+		result.peakVoices = max(result.peakVoices, gVoices.numActive);
+		result.meanVoices += gVoices.numActive / (double)numBlocks;
+	}
+	runner.cleanup();
+
+	const vector<int64_t>& times = runner.blockTimes();
+	for (unsigned int i = 0; i < times.size(); i++) {
+		result.totalNs += times[i];
+		result.worstNs = max(result.worstNs, times[i]);
+	}
+	result.blocks = times.size();
+	result.frames = times.size() * context->audioFrames;
+	result.deadlineNs = 1e9 * context->audioFrames / context->audioSampleRate;
+	result.ok = result.frames > 0;
+	return result;
+}
+
+// Fork, run it in the child (with its output thrown away), and pass the result back.
+static RunResult runInChild(const Scenario *scenario, const char *capturePath, int voices) {
+	RunResult result = RunResult();
+	int fds[2];
+	if (pipe(fds) != 0)
+		return result;
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDOUT_FILENO);
+		gHostQuiet = 1;
+		result = runScenario(scenario, capturePath, voices);
+		ssize_t written = write(fds[1], &result, sizeof(result));
+		_exit(written == sizeof(result) ? 0 : 1);
+	}
+	close(fds[1]);
+	if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result))
+		result.ok = false;
+	close(fds[0]);
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+	return result;
+}
+
+// Run it the given number of times and return the run with the best mean. worstNs is the least
+// bad worst block of them all: a block that is slow in every run is Keppi's, one that is slow in
+// only one is more likely the host's. ok is false if a run failed.
+static RunResult runBest(const Scenario *scenario, const char *capturePath, int voices, int runs,
+	int64_t& worstNs, bool& deterministic) {
+	RunResult best = RunResult();
+	uint64_t firstHash = 0;
+	deterministic = true;
+	for (int r = 0; r < runs; r++) {
+		RunResult result = runInChild(scenario, capturePath, voices);
+		if (!result.ok)
+			return result;
+		if (r == 0) {
+			best = result;
+			firstHash = result.hash;
+			worstNs = result.worstNs;
+		} else if ((double)result.totalNs / result.frames < (double)best.totalNs / best.frames) {
+			best = result;
+		}
+		deterministic = deterministic && result.hash == firstHash;
+		worstNs = min(worstNs, result.worstNs);
+	}
+	return best;
+}
+
+// -c: the dense scenario at each of kCurveVoices, then a straight line through the time per
+// frame against the voices sounding: what a voice costs, and how many would fill the deadline.
+static int runVoiceCurve(int runs) {
+	const Scenario *dense = NULL;
+	for (unsigned int s = 0; s < sizeof(kScenarios) / sizeof(kScenarios[0]); s++)
+		if (strcmp(kScenarios[s].name, "dense") == 0)
+			dense = &kScenarios[s];
+	printf("%s: %s, %.0fs\n", dense->name, dense->description, dense->seconds);
+	printf("%7s %9s %9s %11s %11s %9s\n", "voices", "sounding", "ns/frame", "us/block", "worst (us)", "% block");
+	double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0, deadlineNs = 0;
+	int n = sizeof(kCurveVoices) / sizeof(kCurveVoices[0]);
+	for (int i = 0; i < n; i++) {
+		int64_t worstNs = 0;
+		bool deterministic;
+		RunResult result = runBest(dense, NULL, kCurveVoices[i], runs, worstNs, deterministic);
+		if (!result.ok) {
+			printf("%7d failed to run\n", kCurveVoices[i]);
+			return 1;
+		}
+		double ns = (double)result.totalNs / result.frames;
+		printf("%7d %9.1f %9.1f %11.2f %11.1f %9.1f\n", kCurveVoices[i], result.meanVoices, ns,
+			(double)result.totalNs / result.blocks / 1000.0, worstNs / 1000.0, 100.0 * worstNs / result.deadlineNs);
+		sumX += result.meanVoices;
+		sumY += ns;
+		sumXX += result.meanVoices * result.meanVoices;
+		sumXY += result.meanVoices * ns;
+		deadlineNs = result.deadlineNs / (result.frames / result.blocks);
+	}
+	double perVoice = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+	double base = (sumY - perVoice * sumX) / n;
+	printf("About %.1f ns/frame plus %.2f ns/frame per voice sounding", base, perVoice);
+	if (perVoice > 0)
+		printf(": %.0f voices would fill the deadline", (deadlineNs - base) / perVoice);
+	printf("\n");
+	return 0;
+}
+
+static std::map<string, string> loadGolden(const string& path) {
+	std::map<string, string> golden;
+	FILE *file = fopen(path.c_str(), "r");
+	if (!file)
+		return golden;
+	char line[512], name[256], hash[64];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] != '#' && sscanf(line, "%255s %63s", name, hash) == 2)
+			golden[name] = hash;
+	}
+	fclose(file);
+	return golden;
+}
+
+static bool saveGolden(const string& path, const std::map<string, string>& golden) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "# keppi_bench output hashes: <scenario> <hash>. After a change meant to change the\n");
+	fprintf(file, "# sound, check it by ear and run keppi_bench -u to store the new ones.\n");
+	for (std::map<string, string>::const_iterator it = golden.begin(); it != golden.end(); ++it)
+		fprintf(file, "%s %s\n", it->first.c_str(), it->second.c_str());
+	return fclose(file) == 0;
+}
+
+// Output paths are given relative to where we were started, not the project.
+static string absolutePath(const char *path)
+{
+	if (path[0] == '/')
+		return path;
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd)))
+		return path;
+	return string(cwd) + "/" + path;
+}
+
+void usage(const char *processName)
+{
+	cerr << "Usage: " << processName << " [-P project] [-g golden] [-n runs] [-v voices] [-u] [-l] [scenario | capture.kcap ...]\n";
+	cerr << "       " << processName << " [-P project] [-n runs] -c\n";
+	cerr << "   -P project:  The project folder, with the samples (default ../Keppi)\n";
+	cerr << "   -g golden:   The stored output hashes (default bench_golden.txt)\n";
+	cerr << "   -n runs:     Runs of each scenario (default 3)\n";
+	cerr << "   -v voices:   Polyphony to run at (default " << DEFAULT_VOICES << "; others aren't checked against the golden file)\n";
+	cerr << "   -u:          Store the output hashes as the golden ones\n";
+	cerr << "   -c:          Time the dense scenario at 1 to " << MAX_VOICES << " voices\n";
+	cerr << "   -l:          List the scenarios\n";
+}
+
+int main(int argc, char *argv[])
+{
+	const char *projectDir = "../Keppi";
+	string goldenPath = absolutePath("bench_golden.txt");
+	int runs = 3;
+	int voices = DEFAULT_VOICES;
+	bool update = false;
+	bool curve = false;
+	int c;
+	while ((c = getopt(argc, argv, "P:g:n:v:uclh")) >= 0) {
+		switch (c) {
+		case 'P': projectDir = optarg; break;
+		case 'g': goldenPath = absolutePath(optarg); break;
+		case 'n': runs = atoi(optarg); break;
+		case 'v': voices = atoi(optarg); break;
+		case 'u': update = true; break;
+		case 'c': curve = true; break;
+		case 'l':
+			for (unsigned int s = 0; s < sizeof(kScenarios) / sizeof(kScenarios[0]); s++)
+				printf("%-12s %4.0fs  %s\n", kScenarios[s].name, kScenarios[s].seconds, kScenarios[s].description);
+			return 0;
+		default:
+			usage(basename(argv[0]));
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (runs < 1 || voices < 1 || voices > MAX_VOICES || (update && voices != DEFAULT_VOICES)) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	// What to run: scenarios by name, and captures (by their paths, as given).
+	vector<const Scenario *> scenarios;
+	vector<string> captures;
+	for (int i = optind; i < argc; i++) {
+		const Scenario *found = NULL;
+		for (unsigned int s = 0; s < sizeof(kScenarios) / sizeof(kScenarios[0]); s++)
+			if (strcmp(argv[i], kScenarios[s].name) == 0)
+				found = &kScenarios[s];
+		if (found) {
+			scenarios.push_back(found);
+		} else if (access(argv[i], R_OK) == 0) {
+			captures.push_back(absolutePath(argv[i]));
+		} else {
+			cerr << "No scenario or capture " << argv[i] << " (-l lists the scenarios)" << endl;
+			return 1;
+		}
+	}
+	if (optind == argc)
+		for (unsigned int s = 0; s < sizeof(kScenarios) / sizeof(kScenarios[0]); s++)
+			scenarios.push_back(&kScenarios[s]);
+
+	std::map<string, string> golden = loadGolden(goldenPath);
+	if (chdir(projectDir) != 0) {
+		cerr << "Couldn't change to project folder " << projectDir << endl;
+		return 1;
+	}
+	if (curve)
+		return runVoiceCurve(runs);
+
+	printf("%-14s %9s %11s %9s %11s  %-16s %s\n", "scenario", "ns/frame", "worst (us)", "% block", "voices", "hash", "");
+	bool allOk = true;
+	for (unsigned int i = 0; i < scenarios.size() + captures.size(); i++) {
+		const Scenario *scenario = i < scenarios.size() ? scenarios[i] : NULL;
+		const char *capturePath = scenario ? NULL : captures[i - scenarios.size()].c_str();
+		string name = scenario ? scenario->name : captures[i - scenarios.size()].substr(captures[i - scenarios.size()].rfind('/') + 1);
+
+		int64_t worstNs = 0;
+		bool deterministic;
+		RunResult best = runBest(scenario, capturePath, voices, runs, worstNs, deterministic);
+		if (!best.ok) {
+			printf("%-14s failed to run\n", name.c_str());
+			allOk = false;
+			continue;
+		}
+
+		char hash[32];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)best.hash);
+		string status;
+		if (!deterministic) {
+			status = "DIFFERS BETWEEN RUNS";
+			allOk = false;
+		} else if (voices != DEFAULT_VOICES) {
+			status = "not checked (-v)";
+		} else if (update) {
+			status = golden.count(name) && golden[name] != hash ? "updated" : "stored";
+			golden[name] = hash;
+		} else if (!golden.count(name)) {
+			status = "new (-u to store)";
+		} else if (golden[name] == hash) {
+			status = "ok";
+		} else {
+			status = "CHANGED (was " + golden[name] + ")";
+			allOk = false;
+		}
+		char sounding[32];
+		snprintf(sounding, sizeof(sounding), "%d (%.1f)", best.peakVoices, best.meanVoices);
+		printf("%-14s %9.1f %11.1f %9.1f %11s  %-16s %s\n", name.c_str(), (double)best.totalNs / best.frames,
+			worstNs / 1000.0, 100.0 * worstNs / best.deadlineNs, sounding, hash, status.c_str());
+	}
+
+	if (update && !saveGolden(goldenPath, golden)) {
+		cerr << "Couldn't write " << goldenPath << endl;
+		return 1;
+	}
+	return allOk ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+/***** keppi_cache.cpp *****/
+/*
+ * Writes the pre-converted sample cache (Keppi/sampleCache.hpp) for each WAV
+ * given, so the instrument's first boot doesn't have to do it:
+ *
+ *   keppi_cache [-c channel] [-s] ../Keppi/clay*.wav
+ *
+ * (-s for 16-bit samples, when Keppi's useInt16Samples is set.)
+ *
+ * Caches that are already up to date are left alone.
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <SampleLoader.h>
+#include "sampleCache.hpp"
+
+int main(int argc, char *argv[])
+{
+	int channel = 0;
+	int format = SAMPLE_CACHE_FORMAT_FLOAT;
+	int c;
+	while((c = getopt(argc, argv, "c:sh")) >= 0) {
+		switch(c) {
+		case 'c': channel = atoi(optarg); break;
+		case 's': format = SAMPLE_CACHE_FORMAT_INT16; break;
+		default:
+			cerr << "Usage: " << basename(argv[0]) << " [-c channel] [-s] file.wav...\n";
+			cerr << "   -s: 16-bit samples, for Keppi's useInt16Samples\n";
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	int failures = 0;
+	for(int i = optind; i < argc; i++) {
+		string file = argv[i];
+		SampleData sample = SampleData();
+		if(loadSampleCache(file, channel, format, &sample)) {
+			cout << file << ": up to date (" << sample.sampleLen << " frames)\n";
+			freeSampleData(&sample);
+			continue;
+		}
+		if(loadSample(file, channel, &sample) != 0) {
+			failures++;
+			continue;
+		}
+		if(format == SAMPLE_CACHE_FORMAT_INT16)
+			convertSampleToInt16(&sample);
+		if(!writeSampleCache(file, channel, &sample)) {
+			cerr << file << ": couldn't write " << sampleCachePath(file) << endl;
+			failures++;
+		} else {
+			cout << file << ": wrote " << sampleCachePath(file) << " (" << sample.sampleLen << " frames)\n";
+		}
+		freeSampleData(&sample);
+	}
+	return failures ? 1 : 0;
+}
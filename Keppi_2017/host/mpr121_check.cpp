@@ -0,0 +1,127 @@
+/***** mpr121_check.cpp *****/
+/*
+ * Runs an I2C_MPR121 driver against the simulated MPR121 and checks it:
+ *
+ * - begin() must leave the chip configured the way the Keppi relies on
+ *   (thresholds, baseline filter, sample period, 12 electrodes in run mode),
+ *   with every configuration write made before run mode is entered
+ * - a scripted touch must be reported on the right electrode
+ *
+ * and then reports what one poll of all 12 electrodes (touch status,
+ * filtered data and baselines) costs on the bus: the one-value-at-a-time
+ * reads every copy of the driver has, and readAll() where the driver has it.
+ *
+ * The Makefile builds it once per driver copy (Keppi/ and
+ * Testing library/capTouch_tester/). Returns non-zero if a check fails.
+ */
+
+#include <stdio.h>
+#include "I2C_MPR121.h"
+#include "MPR121Sim.h"
+
+struct ExpectedRegister {
+	uint8_t reg;
+	uint8_t value;
+	const char *name;
+};
+
+static const ExpectedRegister kExpected[] = {
+	{ MPR121_MHDR, 0x01, "MHDR" },
+	{ MPR121_NHDR, 0x01, "NHDR" },
+	{ MPR121_NCLR, 0x0E, "NCLR" },
+	{ MPR121_FDLR, 0x00, "FDLR" },
+	{ MPR121_MHDF, 0x01, "MHDF" },
+	{ MPR121_NHDF, 0x05, "NHDF" },
+	{ MPR121_NCLF, 0x01, "NCLF" },
+	{ MPR121_NHDT, 0x00, "NHDT" },
+	{ MPR121_NCLT, 0x00, "NCLT" },
+	{ MPR121_FDLT, 0x00, "FDLT" },
+	{ MPR121_DEBOUNCE, 0x00, "DEBOUNCE" },
+	{ MPR121_CONFIG1, 0x10, "CONFIG1" },	// 16uA charge current
+	{ MPR121_CONFIG2, 0x20, "CONFIG2" },	// 0.5us charge time, 1ms sample period
+	{ MPR121_ECR, 0x8F, "ECR" },			// 12 electrodes, baseline from the top 5 bits
+};
+
+#define TOUCH_THRESHOLD 12
+#define RELEASE_THRESHOLD 6
+
+static int gFailures = 0;
+
+static void check(bool ok, const char *what) {
+	printf("  %s  %s\n", ok ? "ok  " : "FAIL", what);
+	if(!ok)
+		gFailures++;
+}
+
+static void printPollCost(const char *name, const HostI2cStats& stats, int polls) {
+	printf("  %-10s %5.1f transactions, %6.1f bytes, %7.1f us of bus at 400kHz per poll\n", name,
+		(double)stats.transactions / polls, (double)(stats.bytesWritten + stats.bytesRead) / polls,
+		HostI2c_busTimeUs(stats) / polls);
+}
+
+int main(int argc, char *argv[])
+{
+	MPR121Sim sim;
+	I2C_MPR121 mpr121;
+	HostI2c_attach(MPR121_I2CADDR_DEFAULT, &sim);
+
+	printf("begin():\n");
+	check(mpr121.begin(1, MPR121_I2CADDR_DEFAULT), "returns true");
+	for(unsigned int i = 0; i < sizeof(kExpected) / sizeof(kExpected[0]); i++) {
+		char what[64];
+		uint8_t value = sim.getRegister(kExpected[i].reg);
+		snprintf(what, sizeof(what), "%s = 0x%02X (0x%02X)", kExpected[i].name, kExpected[i].value, value);
+		check(value == kExpected[i].value, what);
+	}
+	bool thresholdsOk = true;
+	for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++) {
+		thresholdsOk = thresholdsOk && sim.getRegister(MPR121_TOUCHTH_0 + 2 * e) == TOUCH_THRESHOLD
+			&& sim.getRegister(MPR121_RELEASETH_0 + 2 * e) == RELEASE_THRESHOLD;
+	}
+	check(thresholdsOk, "touch/release thresholds 12/6 on every electrode");
+
+	// The chip drops configuration writes in run mode, so they must all come
+	// between the soft reset and the final write to ECR.
+	const std::vector<MPR121SimWrite>& log = sim.getWriteLog();
+	bool orderOk = !log.empty() && log.front().reg == MPR121_SOFTRESET && log.back().reg == MPR121_ECR;
+	for(unsigned int i = 1; i + 1 < log.size(); i++)
+		orderOk = orderOk && !(log[i].reg == MPR121_ECR && (log[i].value & 0x0F));
+	check(orderOk, "soft reset first, run mode entered last");
+	printf("  (%u register writes; FDLF = 0x%02X)\n", (unsigned int)log.size(), sim.getRegister(MPR121_FDLF));
+
+	// Let the baselines settle, then touch electrode 3.
+	sim.advanceTo(0.5);
+	sim.scheduleTouched(0.5, 1 << 3);
+	sim.advanceTo(0.51);
+	check(sim.irqAsserted(), "IRQ asserted on touch");
+	check(mpr121.touched() == (1 << 3), "touched() reports electrode 3");
+	check(!sim.irqAsserted(), "IRQ released by reading the status");
+	check(mpr121.filteredData(3) < mpr121.baselineData(3) - TOUCH_THRESHOLD, "filtered data below the baseline");
+	sim.scheduleTouched(0.6, 0);
+	sim.advanceTo(0.61);
+	check(mpr121.touched() == 0, "release reported");
+
+	printf("Bus cost of polling all %d electrodes:\n", MPR121SIM_NUM_ELECTRODES);
+	const int polls = 100;
+	HostI2c_resetStats(MPR121_I2CADDR_DEFAULT);
+	for(int p = 0; p < polls; p++) {
+		mpr121.touched();
+		for(int e = 0; e < MPR121SIM_NUM_ELECTRODES; e++) {
+			mpr121.filteredData(e);
+			mpr121.baselineData(e);
+		}
+	}
+	printPollCost("per value", HostI2c_getStats(MPR121_I2CADDR_DEFAULT), polls);
+#ifdef MPR121_BURST_LEN
+	MPR121Data data;
+	HostI2c_resetStats(MPR121_I2CADDR_DEFAULT);
+	for(int p = 0; p < polls; p++)
+		mpr121.readAll(&data);
+	printPollCost("readAll()", HostI2c_getStats(MPR121_I2CADDR_DEFAULT), polls);
+#else
+	printf("  (this copy of the driver has no readAll())\n");
+#endif
+
+	printf(gFailures ? "%d check(s) failed\n" : "All checks passed\n", gFailures);
+	return gFailures ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/***** render_offline.cpp *****/
+/*
+ * Offline renderer: runs a Bela project's setup()/render()/cleanup() on the
+ * host, fed from recorded sensor data, and writes the audio output to a WAV
+ * file plus the wall-clock time of every render() call.
+ *
+ * Inputs:
+ *   --analog file   raw 32-bit floats, all analog channels interleaved per
+ *                   analog frame (8 channels at 22.05kHz by default)
+ *   --touch file    text, one "<audio frame> <electrode mask>" or
+ *                   "<audio frame> <electrode> <strength>" per line, played
+ *                   into the simulated MPR121 (see MPR121Sim.h)
+ *   --irq           read the MPR121 when its simulated IRQ line goes low
+ *                   (Keppi's interrupt mode) rather than polling
+ *   --capture file  a capture from Keppi (see Keppi/capture.hpp) instead of
+ *                   --analog and --touch: its analog input, and its MPR121
+ *                   reads given to the driver at the frames they were made,
+ *                   with the block size and IRQ mode it was made with
+ */
+
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "HostRunner.h"
+#include "MPR121Sim.h"
+#include "HostCapture.h"
+
+using namespace std;
+
+// Keppi's MPR121 interrupt mode settings (render.cpp). Weak, so that projects
+// without them (e.g. the testers) still link.
+int useInterrupt __attribute__((weak)) = 0;
+int interruptPin __attribute__((weak)) = 1;
+// And the ones a capture was made with, to check against.
+int readIntervalSamples __attribute__((weak)) = 0;
+int touchEventDelay __attribute__((weak)) = 0;
+// Keppi's polyphony, as --voices sets it on the board (Keppi/main.cpp).
+int numVoices __attribute__((weak)) = 0;
+
+void usage(const char *processName)
+{
+	cerr << "Usage: " << processName << " [options]\n";
+	cerr << "   --project [-P] dir:       Run from this project folder (where the samples are)\n";
+	cerr << "   --analog [-a] file:       Raw float analog input recording\n";
+	cerr << "   --touch [-t] file:        Touch timeline (\"frame mask\" or \"frame electrode strength\" per line)\n";
+	cerr << "   --output [-o] file:       Write the audio output to this WAV file\n";
+	cerr << "   --timing [-T] file:       Write per-block render() times (CSV)\n";
+	cerr << "   --seconds [-s] seconds:   Length to render (default: analog file length, or 10)\n";
+	cerr << "   --period [-p] frames:     Audio frames per block (default 16)\n";
+	cerr << "   --irq [-i]:               Read the MPR121 on its (simulated) IRQ line instead of polling\n";
+	cerr << "   --capture [-c] file:      Play a capture from Keppi instead of --analog and --touch\n";
+	cerr << "   --voices [-v] voices:     How many samples Keppi can sound at once (default its own)\n";
+	cerr << "   --quiet [-q]:             Discard rt_printf() output\n";
+	cerr << "   --help [-h]:              Print this menu\n";
+}
+
+// Output paths are given relative to where we were started, not the project.
+static string absolutePath(const char *path)
+{
+	if(path[0] == '/')
+		return path;
+	char cwd[4096];
+	if(!getcwd(cwd, sizeof(cwd)))
+		return path;
+	return string(cwd) + "/" + path;
+}
+
+int main(int argc, char *argv[])
+{
+	HostSettings settings;
+	const char *projectDir = NULL;
+	const char *analogPath = NULL;
+	const char *touchPath = NULL;
+	const char *capturePath = NULL;
+	string outputPath;
+	string timingPath;
+	float seconds = -1;
+
+	struct option customOptions[] =
+	{
+		{"project", 1, NULL, 'P'},
+		{"analog", 1, NULL, 'a'},
+		{"touch", 1, NULL, 't'},
+		{"output", 1, NULL, 'o'},
+		{"timing", 1, NULL, 'T'},
+		{"seconds", 1, NULL, 's'},
+		{"period", 1, NULL, 'p'},
+		{"irq", 0, NULL, 'i'},
+		{"capture", 1, NULL, 'c'},
+		{"voices", 1, NULL, 'v'},
+		{"quiet", 0, NULL, 'q'},
+		{"help", 0, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	while (1) {
+		int c;
+		if ((c = getopt_long(argc, argv, "P:a:t:o:T:s:p:ic:v:qh", customOptions, NULL)) < 0)
+			break;
+		switch (c) {
+		case 'P': projectDir = optarg; break;
+		case 'a': analogPath = optarg; break;
+		case 't': touchPath = optarg; break;
+		case 'o': outputPath = absolutePath(optarg); break;
+		case 'T': timingPath = absolutePath(optarg); break;
+		case 's': seconds = atof(optarg); break;
+		case 'p': settings.periodSize = atoi(optarg); break;
+		case 'i': useInterrupt = 1; break;
+		case 'c': capturePath = optarg; break;
+		case 'v': numVoices = atoi(optarg); break;
+		case 'q': gHostQuiet = 1; break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case '?':
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	// Read the recordings before changing into the project folder, so that
+	// relative paths are relative to where we were started.
+	vector<float> analogRecording;
+	if(analogPath) {
+		FILE *file = fopen(analogPath, "rb");
+		if(!file) {
+			cerr << "Couldn't open analog recording " << analogPath << endl;
+			return 1;
+		}
+		float buf[4096];
+		size_t got;
+		while((got = fread(buf, sizeof(float), 4096, file)) > 0)
+			analogRecording.insert(analogRecording.end(), buf, buf + got);
+		fclose(file);
+	}
+	CaptureHeader captureHeader;
+	vector<CapturedRead> capturedReads;
+	if(capturePath) {
+		if(analogPath || touchPath) {
+			cerr << "--capture replaces --analog and --touch" << endl;
+			return 1;
+		}
+		if(!loadCapture(capturePath, settings.analogChannels, captureHeader, analogRecording, capturedReads)) {
+			cerr << "Couldn't load capture " << capturePath << endl;
+			return 1;
+		}
+		settings.periodSize = captureHeader.audioFrames;
+		useInterrupt = captureHeader.useInterrupt;
+	}
+	MPR121Sim mpr121Sim;
+	HostI2c_attach(0x5A, &mpr121Sim);
+	if(touchPath && !mpr121Sim.loadTimeline(touchPath, settings.audioSampleRate)) {
+		cerr << "Couldn't open touch timeline " << touchPath << endl;
+		return 1;
+	}
+
+	if(projectDir && chdir(projectDir) != 0) {
+		cerr << "Couldn't change to project folder " << projectDir << endl;
+		return 1;
+	}
+
+	HostRunner runner;
+	if(!runner.setup(settings)) {
+		cerr << "setup() failed" << endl;
+		return 1;
+	}
+	BelaContext *context = runner.getContext();
+	if(capturePath) {
+		if(context->analogFrames != captureHeader.analogFrames) {
+			cerr << "The capture has " << captureHeader.analogFrames << " analog frames per block; we have "
+				<< context->analogFrames << endl;
+			return 1;
+		}
+		if(readIntervalSamples != (int)captureHeader.readIntervalSamples || touchEventDelay != captureHeader.touchEventDelay)
+			cerr << "Warning: the capture was made with readIntervalSamples " << captureHeader.readIntervalSamples
+				<< " and touchEventDelay " << captureHeader.touchEventDelay << "; we have " << readIntervalSamples
+				<< " and " << touchEventDelay << ", so the MPR121 reads won't line up" << endl;
+		// We collect a read's touches at the start of the next block. Count the ones that
+		// were collected later than that, and after they were due, so were handled later.
+		int late = 0;
+		for(unsigned int i = 0; i < capturedReads.size(); i++) {
+			uint64_t nextBlock = (capturedReads[i].frame / context->audioFrames + 1) * context->audioFrames;
+			uint64_t due = max(capturedReads[i].frame + captureHeader.touchEventDelay, nextBlock);
+			if(capturedReads[i].data.collectedFrame > due)
+				late++;
+		}
+		if(late)
+			cerr << "Warning: " << late << " of the " << capturedReads.size() << " MPR121 reads in the capture"
+				<< " were handled later than they will be here (touchEventDelay is too short)" << endl;
+	}
+
+	uint64_t totalFrames;
+	int analogSamplesPerBlock = context->analogFrames * context->analogInChannels;
+	if(seconds >= 0)
+		totalFrames = seconds * context->audioSampleRate;
+	else if(analogPath || capturePath)
+		totalFrames = (analogRecording.size() / analogSamplesPerBlock) * context->audioFrames;
+	else
+		totalFrames = 10 * context->audioSampleRate;
+	uint64_t numBlocks = totalFrames / context->audioFrames;
+
+	vector<float> output;
+	output.reserve(numBlocks * context->audioFrames * context->audioOutChannels);
+	// Only count the traffic from render() on; setup() has done its programming.
+	HostI2c_resetStats(0x5A);
+
+	unsigned int nextRead = 0;
+	for(uint64_t block = 0; block < numBlocks && !gShouldStop; block++) {
+		if(capturePath) {
+			// Give the driver the capture's read if one was made in this block (loadCapture()
+			// has checked there's at most one), and pull the IRQ line low from its frame.
+			uint64_t start = runner.framesElapsed();
+			runner.setDigitalInput(interruptPin, 1);
+			if(nextRead < capturedReads.size() && capturedReads[nextRead].frame < start + context->audioFrames) {
+				const CapturedRead& read = capturedReads[nextRead++];
+				mpr121Sim.setData(read.data.touched, read.data.filtered, read.data.baseline);
+				runner.setDigitalInput(interruptPin, 0, read.frame > start ? read.frame - start : 0);
+			}
+		} else {
+			// The chip runs on its own clock: catch it up to the start of the block.
+			mpr121Sim.advanceTo(runner.framesElapsed() / (double)context->audioSampleRate);
+			// The IRQ output is active low.
+			runner.setDigitalInput(interruptPin, !mpr121Sim.irqAsserted());
+		}
+
+		float *analogIn = runner.analogInput();
+		size_t offset = block * analogSamplesPerBlock;
+		for(int i = 0; i < analogSamplesPerBlock; i++)
+			analogIn[i] = offset + i < analogRecording.size() ? analogRecording[offset + i] : 0;
+
+		runner.renderBlock();
+
+		const float *audioOut = runner.audioOutput();
+		output.insert(output.end(), audioOut, audioOut + context->audioFrames * context->audioOutChannels);
+	}
+
+	runner.cleanup();
+
+	const vector<int64_t>& times = runner.blockTimes();
+	int64_t total = 0, worst = 0;
+	for(unsigned int i = 0; i < times.size(); i++) {
+		total += times[i];
+		worst = max(worst, times[i]);
+	}
+	double deadlineNs = 1e9 * context->audioFrames / context->audioSampleRate;
+	if(!times.empty()) {
+		cerr << "Rendered " << times.size() << " blocks of " << context->audioFrames << " frames\n";
+		cerr << "render(): mean " << total / (int64_t)times.size() << " ns, worst " << worst
+			<< " ns (" << 100.0 * worst / deadlineNs << "% of the " << (int64_t)deadlineNs << " ns deadline)\n";
+	}
+	HostI2cStats i2cStats = HostI2c_getStats(0x5A);
+	if(i2cStats.transactions > 0) {
+		double runUs = 1e6 * runner.framesElapsed() / context->audioSampleRate;
+		double busUs = HostI2c_busTimeUs(i2cStats);
+		cerr << "MPR121: " << i2cStats.transactions << " I2C transactions (" << i2cStats.readTransactions
+			<< " with reads), " << i2cStats.bytesWritten + i2cStats.bytesRead << " bytes, "
+			<< busUs / 1000 << " ms of bus time at 400kHz (" << 100.0 * busUs / runUs << "% of the run)\n";
+	}
+
+	if(!timingPath.empty()) {
+		FILE *file = fopen(timingPath.c_str(), "w");
+		if(!file) {
+			cerr << "Couldn't write timing file " << timingPath << endl;
+			return 1;
+		}
+		fprintf(file, "block,start_frame,render_ns\n");
+		for(unsigned int i = 0; i < times.size(); i++)
+			fprintf(file, "%u,%llu,%lld\n", i, (unsigned long long)i * context->audioFrames, (long long)times[i]);
+		fclose(file);
+	}
+	if(!outputPath.empty() && !writeWavFile(outputPath, output, context->audioOutChannels, context->audioSampleRate)) {
+		cerr << "Couldn't write " << outputPath << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,22 @@
+/***** rtdk.h (host) *****/
+
+#ifndef HOST_RTDK_H_
+#define HOST_RTDK_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Set to 1 by the offline renderer's --quiet flag.
+extern int gHostQuiet;
+
+static inline int rt_printf(const char *format, ...) {
+	if(gHostQuiet)
+		return 0;
+	va_list args;
+	va_start(args, format);
+	int ret = vprintf(format, args);
+	va_end(args);
+	return ret;
+}
+
+#endif /* HOST_RTDK_H_ */
@@ -0,0 +1,57 @@
+/***** sndfile.h (host) *****/
+/*
+ * The subset of libsndfile that SampleLoader.h uses, for reading WAV files
+ * (8/16/24/32-bit PCM and 32/64-bit float) when libsndfile isn't installed.
+ */
+
+#ifndef HOST_SNDFILE_H_
+#define HOST_SNDFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef int64_t sf_count_t;
+
+typedef struct {
+	sf_count_t frames;
+	int samplerate;
+	int channels;
+	int format;
+	int sections;
+	int seekable;
+} SF_INFO;
+
+typedef struct SNDFILE_tag SNDFILE;
+
+enum {
+	SF_FORMAT_WAV = 0x010000,
+
+	SF_FORMAT_PCM_S8 = 0x0001,
+	SF_FORMAT_PCM_16 = 0x0002,
+	SF_FORMAT_PCM_24 = 0x0003,
+	SF_FORMAT_PCM_32 = 0x0004,
+	SF_FORMAT_PCM_U8 = 0x0005,
+	SF_FORMAT_FLOAT = 0x0006,
+	SF_FORMAT_DOUBLE = 0x0007,
+
+	SF_FORMAT_SUBMASK = 0x0000FFFF,
+	SF_FORMAT_TYPEMASK = 0x0FFF0000
+};
+
+enum {
+	SFM_READ = 0x10
+};
+
+enum {
+	SFC_CALC_SIGNAL_MAX = 0x1040
+};
+
+SNDFILE *sf_open(const char *path, int mode, SF_INFO *sfinfo);
+int sf_close(SNDFILE *sndfile);
+sf_count_t sf_seek(SNDFILE *sndfile, sf_count_t frames, int whence);
+sf_count_t sf_read_float(SNDFILE *sndfile, float *ptr, sf_count_t items);
+sf_count_t sf_readf_float(SNDFILE *sndfile, float *ptr, sf_count_t frames);
+int sf_command(SNDFILE *sndfile, int command, void *data, int datasize);
+const char *sf_strerror(SNDFILE *sndfile);
+
+#endif /* HOST_SNDFILE_H_ */